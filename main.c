@@ -5,6 +5,10 @@
 //  Created by Michael Dokken on 12/28/24.
 //
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np, sched_getcpu, CPU_SET
+#endif
+
 #include <stdio.h> // printf
 #include <stdlib.h> // qsort, srand, rand, malloc, free
 #include <math.h> // pow, sqrt, erf
@@ -14,33 +18,19 @@
 #include <pthread.h> // pthread_create, pthread_join, pthread_t
 #include <inttypes.h> // uint64_t, uint32_t, int64_t
 #include <unistd.h> // getpid
+#if defined(__linux__)
+#include <sys/syscall.h> // SYS_move_pages
+#endif
 
-typedef uint64_t U64;
-typedef uint32_t U32;
-typedef int64_t I64;
-
-//static I64 COMPARE_COUNTER = 0;
-static __thread I64 COMPARE_COUNTER = 0;// thread local variable, makes sorting 13% slower but allows each thread to have it's own compare counter
-
-// can be used in qsort
-int compare_qsort(const void* a, const void* b) {
-    COMPARE_COUNTER++;
-    return (*(int*)a - *(int*)b);
-}
-
-// returns a - b
-static inline int compareInts(int a, int b) {
-    return compare_qsort(&a, &b);
-    // return a - b;
-}
+#include "shellsort.h" // shellsort_int, shellsort_selectGaps
+#include "shellsort_engine.h" // types, timer, numa placement, worker pool, uncounted int and I64 kernels, gaps_dokken12_222f
 
-#define TICKS_PER_SEC 1000000llu
-static inline U64 currentTime(void) {
-    //return clock();
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    return ((U64)t.tv_usec) + TICKS_PER_SEC * ((U64)t.tv_sec);
-}
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHELLSORT_X86_SIMD 1
+#include <immintrin.h> // AVX2, AVX-512 intrinsics
+#else
+#define SHELLSORT_X86_SIMD 0
+#endif
 
 // returns probability that a statistic is less than z
 double standardNormalCdf(double z) {
@@ -83,6 +73,37 @@ void srand_pcg_easy(void) {
     U64 initInc = ((U64)&_rand_pcg_inc) ^ (((U64)rand()) << 32) ^ (((U64)rand()) << 48);
     srand_pcg(initState, initInc);
 }
+
+// philox4x32-10 counter based generator, a keyed bijection of a 128-bit counter, see "Parallel random numbers: as easy as 1, 2, 3"
+// https://www.thesalmons.org/john/random123/papers/random123sc11.pdf
+void philox4x32(U32 counter[4], U32 const key[2]) {
+    U32 k0 = key[0];
+    U32 k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        U64 p0 = (U64)0xD2511F53u * counter[0];
+        U64 p1 = (U64)0xCD9E8D57u * counter[2];
+        U32 c1 = counter[1];
+        U32 c3 = counter[3];
+        counter[0] = (U32)(p1 >> 32) ^ c1 ^ k0;
+        counter[1] = (U32)p1;
+        counter[2] = (U32)(p0 >> 32) ^ c3 ^ k1;
+        counter[3] = (U32)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+}
+
+// seeds this thread's pcg with philox4x32 of (index, stream) keyed by key, so the random numbers drawn for
+// sample index (its shuffle, its random gaps) depend only on (key, stream, index) and not on the samples generated before it
+// any thread can regenerate any sample, so work can be split between threads in any way and reruns are bit for bit the same
+void srand_pcg_sample(U64 key, U64 stream, U64 index) {
+    U32 counter[4] = {(U32)index, (U32)(index >> 32), (U32)stream, (U32)(stream >> 32)};
+    U32 philoxKey[2] = {(U32)key, (U32)(key >> 32)};
+    philox4x32(counter, philoxKey);
+    _rand_pcg_state = counter[0] | ((U64)counter[1] << 32);
+    _rand_pcg_inc = ((counter[2] | ((U64)counter[3] << 32)) << 1) | 1;
+}
+
 U32 rand_pcg_u32_bounded(U32 range) {
     // return random number in [0, range)
     // this implementation is biased but is very fast
@@ -190,6 +211,105 @@ void printArray(int const array[], I64 length) {
     printf("\n\n");
 }
 
+// narrow rank arrays for sampling, see the CountedU16 and CountedU8 kernels
+// the shuffles consume the same random numbers as shuffleArray, so a U16 or U8 array of ranks gets the same permutation as an int array
+void initializeArrayU16(U16 array[], I64 length) {
+    if (length > (1LL << 16)) {
+        printf("error 206\n");
+        exit(1);
+    }
+    for (I64 i = 0; i < length; i++) {
+        array[i] = (U16)i;
+    }
+}
+
+void initializeArrayU8(U8 array[], I64 length) {
+    if (length > (1LL << 8)) {
+        printf("error 216\n");
+        exit(1);
+    }
+    for (I64 i = 0; i < length; i++) {
+        array[i] = (U8)i;
+    }
+}
+
+void shuffleArrayU16(U16 array[], I64 length) {
+    for (int i = (int)(length-1); i > 0; i--) {
+        int j = rand_pcg_u32_bounded(i+1);
+        U16 temp = array[i];
+        array[i] = array[j];
+        array[j] = temp;
+    }
+}
+
+void shuffleArrayU8(U8 array[], I64 length) {
+    for (int i = (int)(length-1); i > 0; i--) {
+        int j = rand_pcg_u32_bounded(i+1);
+        U8 temp = array[i];
+        array[i] = array[j];
+        array[j] = temp;
+    }
+}
+
+int isArraySortedU16(U16 const array[], I64 length) {
+    for (I64 i = 1; i < length; i++) {
+        if (array[i] <= array[i-1]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int isArraySortedU8(U8 const array[], I64 length) {
+    for (I64 i = 1; i < length; i++) {
+        if (array[i] <= array[i-1]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static inline void swapU16(U16* a, U16* b) {
+    U16 temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+void copyArrayU16(U16 const arrayFrom[], U16 arrayTo[], I64 length) {
+    memcpy(arrayTo, arrayFrom, length * sizeof(U16));
+}
+
+void printArrayU16(U16 const array[], I64 length) {
+    for (I64 i = 0; i < length; i++) {
+        printf("%d, ", array[i]);
+    }
+    printf("\n\n");
+}
+
+// 64-bit rank arrays, for the I64, Float, Double and Record kernels
+// unlike initializeArray there is no limit on length, keys are centered on 0 so both signs are tested
+void initializeArrayI64(I64 array[], I64 length) {
+    I64 j = -(length/2);
+    for (I64 i = 0; i < length; i++) {
+        array[i] = j;
+        j++;
+    }
+}
+
+void shuffleArrayI64(I64 array[], I64 length) {
+    for (I64 i = length-1; i > 0; i--) {
+        I64 j = (length < 1000000000) ? (I64)rand_pcg_u32_bounded((U32)(i+1)) : (I64)(rand_pcg_int64() % (i+1));
+        swapInts64bit(&array[i], &array[j]);
+    }
+}
+
+int isArraySortedI64(I64 const array[], I64 length) {
+    for (I64 i = 1; i < length; i++) {
+        if (array[i-1] > array[i]) return 0;
+    }
+    return 1;
+}
+
 // assumes gap sequence ends with -1 or any negative number
 void printGaps(I64 const gaps[]) {
     printf("{");
@@ -202,276 +322,704 @@ void printGaps(I64 const gaps[]) {
     printf("}");
 }
 
-// assumes we are sorting ints
-void insertionSort(int array[], I64 length) {
-    for (I64 i = 1; i < length; i++) {// i is index of element we need to insert
-        int temp = array[i];
-        I64 j = i-1;
-        while (1) {
-            if (compareInts(array[j], temp) > 0) {
-                array[j+1] = array[j];
-            }
-            else {
-                array[j+1] = temp;
-                break;
-            }
-            if (j == 0) {
-                array[0] = temp;
-                break;
-            }
-            j--;
-        }
+static int NUMA_REPORT = 0;// searches print where their worker buffers ended up after the first round
+
+// numa node of each of numPages pages spread evenly over buffer, from move_pages with no target nodes, returns 0 if unavailable
+// negative entries are pages the kernel couldn't report, usually because they haven't been touched yet
+int queryPageNodes(void const* buffer, I64 bytes, int nodes[], I64 numPages) {
+#if defined(__linux__) && defined(SYS_move_pages)
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    I64 totalPages = (bytes + pageSize - 1) / pageSize;
+    if (numPages > totalPages) {
+        numPages = totalPages;
+    }
+    void** pages = malloc(sizeof(void*) * numPages);
+    for (I64 i = 0; i < numPages; i++) {
+        pages[i] = (char*)buffer + (i * totalPages / numPages) * pageSize;
     }
+    long result = syscall(SYS_move_pages, 0, (unsigned long)numPages, pages, NULL, nodes, 0);
+    free(pages);
+    return result == 0;
+#else
+    (void)buffer;
+    (void)bytes;
+    (void)nodes;
+    (void)numPages;
+    return 0;
+#endif
 }
 
-// assumes first element in gaps/lastGaps is 1, last element in gaps/lastGaps is -1
-void shellSortCustomWithLastGaps(int array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
-    // find initial gap (largest gap that is less than length)
-    I64 g = 0;
-    while (lastGaps[g] < length && lastGaps[g] > 0) {
-        g++;
+// fraction of sampled pages of buffer that aren't on node, -1 if the placement can't be read here
+double remotePageRatio(void const* buffer, I64 bytes, int node) {
+    const I64 numPages = 1024;
+    int nodes[1024];
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    I64 numSampled = (bytes + pageSize - 1) / pageSize < numPages ? (bytes + pageSize - 1) / pageSize : numPages;
+    if (!queryPageNodes(buffer, bytes, nodes, numSampled)) {
+        return -1;
     }
-    
-    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
-        for (I64 i = gap; i < length; i++) {// i is index of element we need to insert
-            int temp = array[i];
-            I64 j = i-gap;
-            I64 j2 = i;
-            while (1) {
-                if (compareInts(array[j], temp) > 0) {
-                    array[j2] = array[j];
-                }
-                else {
-                    array[j2] = temp;
-                    break;
-                }
-                if (j < gap) {
-                    array[j] = temp;
-                    break;
-                }
-                j2 = j - gap;
-                
-                // swap places of j and j2 and repeat what is above
-                
-                if (compareInts(array[j2], temp) > 0) {
-                    array[j] = array[j2];
-                }
-                else {
-                    array[j] = temp;
-                    break;
-                }
-                if (j2 < gap) {
-                    array[j2] = temp;
-                    break;
-                }
-                j = j2 - gap;
-            }
+    I64 numKnown = 0;
+    I64 numRemote = 0;
+    for (I64 i = 0; i < numSampled; i++) {
+        if (nodes[i] >= 0) {
+            numKnown++;
+            numRemote += nodes[i] != node;
         }
     }
-    
-    insertionSort(array, length);
+    return numKnown > 0 ? numRemote / (double)numKnown : -1;
 }
 
-// assumes first element in gaps is 1, last element in gaps is -1
-void shellSortCustom(int array[], I64 length, const I64 gaps[]) {
-    shellSortCustomWithLastGaps(array, length, gaps, gaps);
+// prints how many sampled pages of buffer are on each node
+void printPagePlacement(const char* name, void const* buffer, I64 bytes) {
+    const I64 numPages = 1024;
+    int nodes[1024];
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    I64 numSampled = (bytes + pageSize - 1) / pageSize < numPages ? (bytes + pageSize - 1) / pageSize : numPages;
+    if (!queryPageNodes(buffer, bytes, nodes, numSampled)) {
+        printf("%s: page placement not available\n", name);
+        return;
+    }
+    printf("%s: %lld sampled pages,", name, numSampled);
+    for (int i = 0; i < numaTopology()->numNodes; i++) {
+        int node = numaTopology()->nodes[i];
+        I64 count = 0;
+        for (I64 i = 0; i < numSampled; i++) {
+            count += nodes[i] == node;
+        }
+        printf(" node %d %.1f%%", node, 100.0 * count / numSampled);
+    }
+    printf("\n");
 }
 
-// insert element at index i, return index that it got inserted into
-static I64 shellSortSingleInsert(int array[], I64 gap, I64 i) {
-    int temp = array[i];
-    I64 j = i-gap;
-    I64 j2 = i;
-    while (1) {
-        if (compareInts(array[j], temp) > 0) {
-            array[j2] = array[j];
-        }
-        else {
-            array[j2] = temp;
-            return j2;
-        }
-        if (j < gap) {
-            array[j] = temp;
-            return j;
-        }
-        j2 = j - gap;
-        
-        // swap places of j and j2 and repeat what is above
-        
-        if (compareInts(array[j2], temp) > 0) {
-            array[j] = array[j2];
-        }
-        else {
-            array[j] = temp;
-            return j;
-        }
-        if (j2 < gap) {
-            array[j2] = temp;
-            return j2;
+// after the first round of a search, how many pages of each worker's sample array are on a node other than the one its worker ran on
+// workerNodes[i] is the node worker i last ran on
+void printWorkerBufferPlacement(int* const buffers[], int const workerNodes[], int numThreads, I64 bytes) {
+    double totalRatio = 0;
+    int numKnown = 0;
+    for (int i = 0; i < numThreads; i++) {
+        double ratio = remotePageRatio(buffers[i], bytes, workerNodes[i]);
+        if (ratio >= 0) {
+            totalRatio += ratio;
+            numKnown++;
         }
-        j = j2 - gap;
+    }
+    if (numKnown == 0) {
+        printf("worker buffers: page placement not available\n");
+        return;
+    }
+    printf("worker buffers: %d numa nodes, %.1f%% of sampled pages remote to their worker (pinning %d, huge pages %d)\n",
+           numaTopology()->numNodes, 100.0 * totalRatio / numKnown, PIN_THREADS, USE_HUGE_PAGES);
+}
+
+typedef struct {
+    char* buffer;
+    I64 bytes;
+    I64 numNodes;
+    int cpus[NUMA_MAX_NODES];// a cpu on each node that has cpus
+} InterleaveContext;
+
+// thread k runs on cpus[k], so on the k-th node with cpus, and first touches every numNodes-th 2 MB chunk
+static void interleaveTouchJob(void* context_, I64 threadNum) {
+    InterleaveContext* context = context_;
+    pinCurrentThreadToCpu(context->cpus[threadNum]);
+    for (I64 chunk = threadNum * HUGE_PAGE_BYTES; chunk < context->bytes; chunk += context->numNodes * HUGE_PAGE_BYTES) {
+        I64 end = chunk + HUGE_PAGE_BYTES < context->bytes ? chunk + HUGE_PAGE_BYTES : context->bytes;
+        memset(context->buffer + chunk, 0, end - chunk);
     }
 }
 
-static void shellSortSingleGap(int array[], I64 length, I64 gap) {
-    for (I64 i = gap; i < length; i++) {// i is index of element we need to insert
-        shellSortSingleInsert(array, gap, i);
+// buffer for an array every thread of a multithreaded sort touches, its 2 MB chunks are spread round robin over the numa nodes
+// so the large gap passes draw on every memory controller instead of node 0's, free with freeLargeBuffer
+// first touch needs a thread on the node, so nodes without cpus (memory only) are left out, NUMA_REPORT says when that happens
+void* allocateInterleavedBuffer(I64 bytes) {
+    void* buffer = allocateLargeBuffer(bytes);
+    NumaTopology const* t = numaTopology();
+    InterleaveContext context;
+    context.buffer = buffer;
+    context.bytes = bytes;
+    context.numNodes = 0;
+    for (int i = 0; i < t->numNodes; i++) {
+        for (int k = 0; k < t->numCpus; k++) {
+            if (t->nodeOfCpu[t->compactCpus[k]] == t->nodes[i]) {
+                context.cpus[context.numNodes++] = t->compactCpus[k];
+                break;
+            }
+        }
+    }
+    if (NUMA_REPORT && context.numNodes < t->numNodes) {
+        printf("interleaved buffer: %lld of %d numa nodes have cpus, the others get no pages\n", context.numNodes, t->numNodes);
     }
+    if (context.numNodes > 1) {
+        ShellSortPool* pool = shellSortPoolCreate(context.numNodes);
+        shellSortPoolRun(pool, interleaveTouchJob, &context, context.numNodes);
+        shellSortPoolDestroy(pool);
+    }
+    return buffer;
 }
 
+// the uncounted int and I64 kernels are instantiated in shellsort_engine.h
+
+// counted kernels, every comparison increments COMPARE_COUNTER
+#define KERNEL_SUFFIX
+#define KERNEL_COUNT_TLS
+#include "shellsort_kernels.h"
+
+// counted kernels that keep the count in a local and return it, never touch COMPARE_COUNTER, used by the search engines
+// e.g. I64 compares = shellSortCustomCounted(array, length, gaps);
+#define KERNEL_SUFFIX Counted
+#define KERNEL_COUNT_LOCAL
+#include "shellsort_kernels.h"
+
+// counted kernels on narrow ranks, only relative order matters when sampling, so a shuffled array of ranks
+// 0..length-1 gives identical compare counts with 1/2 or 1/4 of the memory traffic of int
+// U16 for length <= 65536, U8 for length <= 256
+#define KERNEL_SUFFIX CountedU16
+#define KERNEL_TYPE U16
+#define KERNEL_COUNT_LOCAL
+#include "shellsort_kernels.h"
+
+#define KERNEL_SUFFIX CountedU8
+#define KERNEL_TYPE U8
+#define KERNEL_COUNT_LOCAL
+#include "shellsort_kernels.h"
+
+// uncounted kernels for other element types, compares use the key directly so they cannot overflow
+// floats and doubles are compared with >, so NaNs are not ordered
 typedef struct {
-    int* array;
-    I64 length;
-    I64 gap;
-} ShellSortParams;
+    I64 key;
+    I64 payload;
+} Record16;
 
 typedef struct {
-    ShellSortParams const* params;
-    I64 threadNum;
-    I64 totalThreads;
-    I64 compareCount;
-} ShellSortThreadArg;
+    I64 key;
+    I64 payload[3];
+} Record32;
 
-void* shellSortThreadFunc(void* _arg) {
-    ShellSortThreadArg* arg = _arg;
-    ShellSortParams const* params = arg->params;
-    
-    COMPARE_COUNTER = 0;
+#define KERNEL_SUFFIX Float
+#define KERNEL_TYPE float
+#include "shellsort_kernels.h"
+
+#define KERNEL_SUFFIX Double
+#define KERNEL_TYPE double
+#include "shellsort_kernels.h"
+
+#define KERNEL_SUFFIX Record16
+#define KERNEL_TYPE Record16
+#define KERNEL_KEY(x) ((x).key)
+#include "shellsort_kernels.h"
+
+#define KERNEL_SUFFIX Record32
+#define KERNEL_TYPE Record32
+#define KERNEL_KEY(x) ((x).key)
+#include "shellsort_kernels.h"
+
+
+// merge sorts array[0..length) using scratch, returns number of inversions (pairs i < j with array[i] > array[j])
+// merges take the left element on ties, so equal elements are never counted as inversions
+static I64 mergeSortCountInversions(int array[], int scratch[], I64 length) {
+    I64 inversions = 0;
+    int* from = array;
+    int* to = scratch;
+    for (I64 width = 1; width < length; width *= 2) {
+        for (I64 lo = 0; lo < length; lo += 2 * width) {
+            I64 mid = lo + width < length ? lo + width : length;
+            I64 hi = lo + 2 * width < length ? lo + 2 * width : length;
+            I64 i = lo;
+            I64 j = mid;
+            I64 k = lo;
+            while (i < mid && j < hi) {
+                if (from[j] < from[i]) {
+                    inversions += mid - i;
+                    to[k++] = from[j++];
+                }
+                else {
+                    to[k++] = from[i++];
+                }
+            }
+            while (i < mid) {
+                to[k++] = from[i++];
+            }
+            while (j < hi) {
+                to[k++] = from[j++];
+            }
+        }
+        int* temp = from;
+        from = to;
+        to = temp;
+    }
+    if (from != array) {
+        memcpy(array, from, length * sizeof(int));
+    }
+    return inversions;
+}
+
+// sorts the chain array[0], array[gap], ..., array[(length-1)*gap] and returns the exact number of compares
+// shellSortSingleInsert would have used on it, via the identity compares = inversions + (length - left-to-right minima)
+// starts as an in-place insertion counting shifts, and once the shifts exceed a budget of about length*log2(length)
+// the chain is gathered into chain[], the unsorted suffix is merge sorted and the inversions between the sorted prefix
+// and the sorted suffix are counted with one merge, then the chain is scattered back
+// chain and scratch must hold length elements
+static I64 chainInsertionCompares(int array[], I64 gap, I64 length, int chain[], int scratch[]) {
+    if (length < 2) {
+        return 0;
+    }
     
-    I64 gap = params->gap;
-    I64 length = params->length;
-    int* array = params->array;
+    I64 budget = 8 * length;
+    for (I64 n = length; n > 1; n >>= 1) {
+        budget += 2 * length;
+    }
     
-    I64 threadNum = arg->threadNum;
-    I64 totalThreads = arg->totalThreads;
+    I64 inversions = 0;
+    I64 leftToRightMinima = 1;
+    I64 i = 1;
+    for (; i < length && inversions <= budget; i++) {
+        int temp = array[i * gap];
+        I64 j = i;
+        while (j > 0 && array[(j-1) * gap] > temp) {
+            array[j * gap] = array[(j-1) * gap];
+            j--;
+        }
+        array[j * gap] = temp;
+        inversions += i - j;
+        if (j == 0) {
+            leftToRightMinima++;
+        }
+    }
     
-    for (I64 base = gap; 1; base += gap) {
-        for (I64 extra = threadNum; extra < gap; extra += totalThreads) {
-            I64 i = base + extra;
-            if (i >= length) {
-                goto doubleBreak;
+    if (i < length) {
+        // prefix [0, i) is sorted, finish the suffix with merge sort and count the cross inversions while merging
+        for (I64 k = 0; k < length; k++) {
+            chain[k] = array[k * gap];
+        }
+        int runningMin = chain[0];
+        for (I64 k = i; k < length; k++) {
+            if (chain[k] < runningMin) {
+                runningMin = chain[k];
+                leftToRightMinima++;
+            }
+        }
+        inversions += mergeSortCountInversions(&chain[i], scratch, length - i);
+        I64 a = 0;
+        I64 b = i;
+        I64 k = 0;
+        while (a < i && b < length) {
+            if (chain[b] < chain[a]) {
+                inversions += i - a;
+                scratch[k++] = chain[b++];
+            }
+            else {
+                scratch[k++] = chain[a++];
             }
-            shellSortSingleInsert(array, gap, i);
+        }
+        while (a < i) {
+            scratch[k++] = chain[a++];
+        }
+        while (b < length) {
+            scratch[k++] = chain[b++];
+        }
+        for (k = 0; k < length; k++) {
+            array[k * gap] = scratch[k];
         }
     }
-doubleBreak:
     
-    arg->compareCount = COMPARE_COUNTER;
-    return NULL;
+    return inversions + (length - leftToRightMinima);
 }
 
-void shellSortCustomWithLastGapsMultithreaded(int array[], I64 length, const I64 gaps[], const I64 lastGaps[], I64 maxThreads) {
-    const I64 minLengthPerThread = 1 << 17;// at least 2^17 = 131072 per thread
-    if (length < 2 * minLengthPerThread || maxThreads <= 1) {
-        return shellSortCustomWithLastGaps(array, length, gaps, lastGaps);
-        //maxThreads = 1;
+// exact compare count of shellSortCustomWithLastGapsCounted without element-by-element shifting along expensive chains
+// cheap chains are insertion sorted in place, chains that turn out to be badly disordered are finished with a counting merge sort,
+// so a single pass costs O(n log n) instead of O(n^2) on wide gap ratios and adversarial inputs, leaves array sorted
+// scratch is caller owned and must hold 2*length ints
+// assumes first element in gaps/lastGaps is 1, last element in gaps/lastGaps is -1
+I64 shellSortCustomWithLastGapsInversions(int array[], I64 length, const I64 gaps[], const I64 lastGaps[], int scratch[]) {
+    if (length < 2) {
+        return 0;
     }
-    if (maxThreads > 32) {
-        maxThreads = 32;
+    if (scratch == NULL) {
+        printf("error 1054\n");
+        exit(1);
     }
     
-    ShellSortParams params;
-    ShellSortThreadArg* threadArgs = NULL;
-    pthread_t* threads = NULL;
-    if (maxThreads > 1) {
-        params.array = array;
-        params.length = length;
-        threadArgs = malloc(sizeof(ShellSortThreadArg) * maxThreads);
-        for (I64 i = 0; i < maxThreads; i++) {
-            threadArgs[i].params = &params;
-            threadArgs[i].threadNum = i;
-        }
-        threads = malloc(sizeof(pthread_t) * maxThreads);
-    }
+    int* chain = scratch;
+    int* mergeScratch = scratch + length;
+    I64 compares = 0;
     
+    // find initial gap (largest gap that is less than length)
     I64 g = 0;
     while (lastGaps[g] < length && lastGaps[g] > 0) {
         g++;
     }
-    g--;
     
-    I64 gap = lastGaps[g];
-    do {
-        I64 numThreadsToUse = maxThreads;
-        if (numThreadsToUse > 1) {
-            if (numThreadsToUse > gap) {
-                numThreadsToUse = gap;
+    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
+        for (I64 r = 0; r < gap; r++) {
+            I64 chainLength = (length - r + gap - 1) / gap;
+            compares += chainInsertionCompares(&array[r], gap, chainLength, chain, mergeScratch);
+        }
+    }
+    
+    compares += chainInsertionCompares(array, 1, length, chain, mergeScratch);
+    
+    return compares;
+}
+
+// scratch is caller owned and must hold 2*length ints
+// assumes first element in gaps is 1, last element in gaps is -1
+I64 shellSortCustomInversions(int array[], I64 length, const I64 gaps[], int scratch[]) {
+    return shellSortCustomWithLastGapsInversions(array, length, gaps, gaps, scratch);
+}
+
+// vectorized h-pass: for gap >= 8 the chains r, r+1, ..., r+7 sit next to each other in memory,
+// so one row of 8 (AVX2) or 16 (AVX-512) elements is inserted into 8 or 16 chains at once with masked shifts
+// the residues left over after the last full group of lanes, and the partial last row, use the scalar insert
+// counted versions add the popcount of the active lanes at every compare, so they match shellSortCustomWithLastGapsCounted exactly
+// simdLevel: 0 = scalar, 1 = AVX2, 2 = AVX-512
+static int detectSimdLevel(void) {
+#if SHELLSORT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return 2;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static I64 shellSortSingleInsertSimdTail(int array[], I64 gap, I64 i, int counted) {
+    if (counted) {
+        return shellSortSingleInsertCounted(array, gap, i);
+    }
+    shellSortSingleInsertUncounted(array, gap, i);
+    return 0;
+}
+
+#if SHELLSORT_X86_SIMD
+__attribute__((target("avx2,popcnt")))
+static I64 shellSortSingleGapAvx2(int array[], I64 length, I64 gap, int counted) {
+    const I64 lanes = 8;
+    I64 vectorResidues = gap - gap % lanes;
+    I64 compares = 0;
+    for (I64 base = gap; base < length; base += gap) {// base is index of first element of the row we need to insert
+        for (I64 r = 0; r < gap && base + r < length; r++) {
+            I64 i = base + r;
+            if (r >= vectorResidues || i + lanes > length) {
+                compares += shellSortSingleInsertSimdTail(array, gap, i, counted);
+                continue;
             }
-            if (numThreadsToUse > (length - gap) / minLengthPerThread) {
-                numThreadsToUse = (length - gap) / minLengthPerThread;
+            
+            __m256i temp = _mm256_loadu_si256((__m256i const*)&array[i]);
+            __m256i active = _mm256_set1_epi32(-1);
+            I64 j = i - gap;
+            I64 j2 = i;
+            while (1) {
+                __m256i prev = _mm256_loadu_si256((__m256i const*)&array[j]);
+                __m256i greater = _mm256_cmpgt_epi32(prev, temp);
+                __m256i shift = _mm256_and_si256(active, greater);
+                __m256i stop = _mm256_andnot_si256(greater, active);
+                if (counted) {
+                    compares += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(active)));
+                }
+                __m256i current = _mm256_loadu_si256((__m256i const*)&array[j2]);
+                current = _mm256_blendv_epi8(current, prev, shift);
+                current = _mm256_blendv_epi8(current, temp, stop);
+                _mm256_storeu_si256((__m256i*)&array[j2], current);
+                active = shift;
+                if (_mm256_testz_si256(active, active)) {
+                    break;
+                }
+                if (j < gap) {
+                    current = _mm256_loadu_si256((__m256i const*)&array[j]);
+                    current = _mm256_blendv_epi8(current, temp, active);
+                    _mm256_storeu_si256((__m256i*)&array[j], current);
+                    break;
+                }
+                j2 = j;
+                j -= gap;
             }
+            r += lanes - 1;
         }
-        //printf("sort gap=%d, numThreadsToUse=%d\n", gap, numThreadsToUse);
-        if (numThreadsToUse > 1) {
-            params.gap = gap;
-            for (I64 i = 0; i < numThreadsToUse; i++) {
-                threadArgs[i].totalThreads = numThreadsToUse;
-                pthread_create(&threads[i], NULL, shellSortThreadFunc, (void*)&threadArgs[i]);
+    }
+    return compares;
+}
+
+__attribute__((target("avx512f,popcnt")))
+static I64 shellSortSingleGapAvx512(int array[], I64 length, I64 gap, int counted) {
+    const I64 lanes = 16;
+    I64 vectorResidues = gap - gap % lanes;
+    I64 compares = 0;
+    for (I64 base = gap; base < length; base += gap) {// base is index of first element of the row we need to insert
+        for (I64 r = 0; r < gap && base + r < length; r++) {
+            I64 i = base + r;
+            if (r >= vectorResidues || i + lanes > length) {
+                compares += shellSortSingleInsertSimdTail(array, gap, i, counted);
+                continue;
             }
-            for (I64 i = 0; i < numThreadsToUse; i++) {
-                pthread_join(threads[i], NULL);
-                COMPARE_COUNTER += threadArgs[i].compareCount;
+            
+            __m512i temp = _mm512_loadu_si512((void const*)&array[i]);
+            __mmask16 active = 0xFFFF;
+            I64 j = i - gap;
+            I64 j2 = i;
+            while (1) {
+                __m512i prev = _mm512_loadu_si512((void const*)&array[j]);
+                __mmask16 shift = _mm512_mask_cmpgt_epi32_mask(active, prev, temp);
+                __mmask16 stop = active & ~shift;
+                if (counted) {
+                    compares += __builtin_popcount(active);
+                }
+                _mm512_mask_storeu_epi32(&array[j2], shift, prev);
+                _mm512_mask_storeu_epi32(&array[j2], stop, temp);
+                active = shift;
+                if (active == 0) {
+                    break;
+                }
+                if (j < gap) {
+                    _mm512_mask_storeu_epi32(&array[j], active, temp);
+                    break;
+                }
+                j2 = j;
+                j -= gap;
             }
+            r += lanes - 1;
         }
-        else {
-            shellSortSingleGap(array, length, gap);
-        }
-        g--;
-        gap = gaps[g];
-    }
-    while (g > 0);
-    
-    if (maxThreads > 1) {
-        free(threads);
-        free(threadArgs);
     }
-    
-    insertionSort(array, length);
+    return compares;
 }
+#endif
 
-// assumes first element in gaps is 1 and second element in gaps is positive, last element in gaps is -1
-void shellSortCustomAdjustLast(int array[], I64 length, I64 const gaps[]) {
-    
-    if (length <= gaps[1]) {
-        return insertionSort(array, length);
+static I64 shellSortSingleGapSimd(int array[], I64 length, I64 gap, int simdLevel, int counted) {
+#if SHELLSORT_X86_SIMD
+    if (simdLevel >= 2 && gap >= 16) {
+        return shellSortSingleGapAvx512(array, length, gap, counted);
+    }
+    if (simdLevel >= 1 && gap >= 8) {
+        return shellSortSingleGapAvx2(array, length, gap, counted);
     }
+#endif
+    if (counted) {
+        return shellSortSingleGapCounted(array, length, gap);
+    }
+    shellSortSingleGapUncounted(array, length, gap);
+    return 0;
+}
+
+static I64 shellSortCustomWithLastGapsSimdLevel(int array[], I64 length, const I64 gaps[], const I64 lastGaps[], int simdLevel, int counted) {
+    I64 compares = 0;
     
     // find initial gap (largest gap that is less than length)
-    I64 g = 2;
-    while (gaps[g] < length && gaps[g] > 0) {
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
         g++;
     }
-    g--;
     
-    I64 gap;
-    gap = sqrt(gaps[g] * (double)gaps[g+1]);
-    if (gap >= length) {
-        g--;
-        gap = sqrt(gaps[g] * (double)gaps[g+1]);
+    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
+        compares += shellSortSingleGapSimd(array, length, gap, simdLevel, counted);
     }
     
-    do {
-        shellSortSingleGap(array, length, gap);
-        g--;
-        gap = gaps[g];
+    if (counted) {
+        return compares + insertionSortCounted(array, length);
     }
-    while (g > 0);
-    
-    insertionSort(array, length);
+    insertionSortUncounted(array, length);
+    return 0;
 }
 
+// assumes first element in gaps/lastGaps is 1, last element in gaps/lastGaps is -1
+void shellSortCustomWithLastGapsSimdUncounted(int array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    shellSortCustomWithLastGapsSimdLevel(array, length, gaps, lastGaps, detectSimdLevel(), 0);
+}
 
-static const I64 gaps_blaazen[] = {1, 4, 10, 23, 57, 132, 301, 701, 1559, 3463, 7703, 17099, 37957, 83459, 185267, 411211, 912871, 2026567, 4498951, 9987709, 22172701, 49223393, 109275931, 242592563, 538555487, -1};
-// ciura's gap sequence 1, ..., 701, extended using blaazen's prime numbers 1559, 3463, ..., 49223393 found at https://forum.lazarus.freepascal.org/index.php?topic=52551.0
-// I extended further starting with 109275931, ...
-// all of blaazen's gaps after 701 are prime, ratios are approx: 2.223, 2.221, 2.224, 2.2197, 2.2198, 2.198, 2.2198, 2.2195, 2.21995, 2.219992, 2.21998, 2.220008, 2.219998, 2.2199998
-
+// assumes first element in gaps/lastGaps is 1, last element in gaps/lastGaps is -1
+I64 shellSortCustomWithLastGapsSimdCounted(int array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    return shellSortCustomWithLastGapsSimdLevel(array, length, gaps, lastGaps, detectSimdLevel(), 1);
+}
 
-// computed experimentally for minimizing compares, arraySize~=lastGap*8000/301, with 2 extra gaps with randRatio in [2.2,2.8] then [2.3,3.2]
-// has ratios: 4.000, 2.500, 2.300, 2.478, 2.316, 2.280, 2.329, 2.334, 2.237, 2.222, 2.229, 2.227, 2.209, 2.219, 2.242, 2.195, 2.190, 2.203, 2.241, 2.197, 2.22, 2.22, ...
-static const I64 gaps_dokken5_222f[] = {1, 4, 10, 23, 57, 132, 301, 701, 1636, 3659, 8129, 18118, 40354, 89129, 197803, 443557, 973657, 2131981, 4697153, 10528127, 23135351, 51360479, 114020263, 253124983, 561937462, 1247501165, 2769452586, 6148184740, -1};
-static const I64 gaps_dokken5_last[] = {1, 5, 14, 27, 80, 199, 479, 1059, 2337, 5453, 12135, 27039, 59972, 132777, 296204, 657169, 1440770, 3164528, 7032227, 15606790, 33962508, 73189213, -1};// experimentally computed for [1, 5, ..., 2337], then computed as [5453=sqrt(3659*8129), ..., 33962508=sqrt(23135351*49856687)] then computed [73189213=(49856687/23135351)^(3/2)*23135351]
-static const I64 gaps_dokken5_222f_time[] = {1, 10, 57, 301, 1636, 8129, 40354, 197803, 973657, 4697153, 23135351, 114020263, 561937462, 2769452586, -1};// for minimizing time
+// batched sorting of many small independent arrays, one array per SIMD lane
+// the arrays are stored interleaved (structure of arrays), element i of lane l is soa[i * SHELLSORT_BATCH_LANES + l],
+// so one row of SHELLSORT_BATCH_LANES elements is a single AVX-512 vector (or two AVX2 vectors)
+// per-lane compare counts are kept in 32-bit vector lanes within a pass, so length must be at most SHELLSORT_BATCH_MAX_LENGTH
+#define SHELLSORT_BATCH_LANES 16
+#define SHELLSORT_BATCH_MAX_LENGTH 46340
+#define SHELLSORT_BATCH_SAMPLING_MAX_LENGTH 8192// search engines use the batched sampling threads up to this arraySize when SIMD is available
+
+static void shellSortBatchGapScalar(int soa[], I64 length, I64 gap, I64 lane, I64 compares[]) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    for (I64 i = gap; i < length; i++) {
+        compares[lane] += shellSortSingleInsertCounted(&soa[lane], gap * lanes, i * lanes);
+    }
+}
+
+#if SHELLSORT_X86_SIMD
+__attribute__((target("avx2")))
+static void shellSortBatchGapAvx2(int soa[], I64 length, I64 gap, I64 compares[]) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    for (I64 half = 0; half < lanes; half += 8) {
+        __m256i counts = _mm256_setzero_si256();
+        for (I64 i = gap; i < length; i++) {// i is index of row we need to insert
+            __m256i temp = _mm256_loadu_si256((__m256i const*)&soa[i * lanes + half]);
+            __m256i active = _mm256_set1_epi32(-1);
+            I64 j = i - gap;
+            I64 j2 = i;
+            while (1) {
+                __m256i prev = _mm256_loadu_si256((__m256i const*)&soa[j * lanes + half]);
+                counts = _mm256_sub_epi32(counts, active);
+                __m256i greater = _mm256_cmpgt_epi32(prev, temp);
+                __m256i shift = _mm256_and_si256(active, greater);
+                __m256i stop = _mm256_andnot_si256(greater, active);
+                __m256i current = _mm256_loadu_si256((__m256i const*)&soa[j2 * lanes + half]);
+                current = _mm256_blendv_epi8(current, prev, shift);
+                current = _mm256_blendv_epi8(current, temp, stop);
+                _mm256_storeu_si256((__m256i*)&soa[j2 * lanes + half], current);
+                active = shift;
+                if (_mm256_testz_si256(active, active)) {
+                    break;
+                }
+                if (j < gap) {
+                    current = _mm256_loadu_si256((__m256i const*)&soa[j * lanes + half]);
+                    current = _mm256_blendv_epi8(current, temp, active);
+                    _mm256_storeu_si256((__m256i*)&soa[j * lanes + half], current);
+                    break;
+                }
+                j2 = j;
+                j -= gap;
+            }
+        }
+        int laneCounts[8];
+        _mm256_storeu_si256((__m256i*)laneCounts, counts);
+        for (I64 l = 0; l < 8; l++) {
+            compares[half + l] += laneCounts[l];
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void shellSortBatchGapAvx512(int soa[], I64 length, I64 gap, I64 compares[]) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    const __m512i ones = _mm512_set1_epi32(1);
+    __m512i counts = _mm512_setzero_si512();
+    for (I64 i = gap; i < length; i++) {// i is index of row we need to insert
+        __m512i temp = _mm512_loadu_si512((void const*)&soa[i * lanes]);
+        __mmask16 active = 0xFFFF;
+        I64 j = i - gap;
+        I64 j2 = i;
+        while (1) {
+            __m512i prev = _mm512_loadu_si512((void const*)&soa[j * lanes]);
+            counts = _mm512_mask_add_epi32(counts, active, counts, ones);
+            __mmask16 shift = _mm512_mask_cmpgt_epi32_mask(active, prev, temp);
+            __mmask16 stop = active & ~shift;
+            _mm512_mask_storeu_epi32(&soa[j2 * lanes], shift, prev);
+            _mm512_mask_storeu_epi32(&soa[j2 * lanes], stop, temp);
+            active = shift;
+            if (active == 0) {
+                break;
+            }
+            if (j < gap) {
+                _mm512_mask_storeu_epi32(&soa[j * lanes], active, temp);
+                break;
+            }
+            j2 = j;
+            j -= gap;
+        }
+    }
+    int laneCounts[16];
+    _mm512_storeu_si512((void*)laneCounts, counts);
+    for (I64 l = 0; l < lanes; l++) {
+        compares[l] += laneCounts[l];
+    }
+}
+#endif
+
+// sorts SHELLSORT_BATCH_LANES arrays of the same length stored interleaved in soa
+// lane l is sorted with its own gap sequence laneGaps[l] exactly like shellSortCustomCounted, and its compare count is added to compares[l]
+// passes are lined up from the final gap 1 pass upwards, so lanes sharing a gap prefix run those passes together in SIMD lanes,
+// passes where the lanes' gaps differ run lane by lane
+// assumes first element in every laneGaps[l] is 1, last element is -1
+void shellSortBatchCounted(int soa[], I64 length, I64 const* const laneGaps[], I64 compares[]) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    if (length > SHELLSORT_BATCH_MAX_LENGTH) {
+        printf("error 2329\n");
+        exit(1);
+    }
+    int simdLevel = detectSimdLevel();
+    
+    // index of the initial gap of each lane (largest gap that is less than length)
+    I64 topGap[SHELLSORT_BATCH_LANES];
+    I64 maxTopGap = 0;
+    for (I64 l = 0; l < lanes; l++) {
+        I64 g = 0;
+        while (laneGaps[l][g] < length && laneGaps[l][g] > 0) {
+            g++;
+        }
+        topGap[l] = g - 1;
+        if (topGap[l] > maxTopGap) {
+            maxTopGap = topGap[l];
+        }
+    }
+    
+    for (I64 g = maxTopGap; g >= 0; g--) {
+        int uniform = 1;
+        for (I64 l = 0; l < lanes; l++) {
+            if (topGap[l] < g || laneGaps[l][g] != laneGaps[0][g]) {
+                uniform = 0;
+                break;
+            }
+        }
+        
+        if (!uniform) {
+            for (I64 l = 0; l < lanes; l++) {
+                if (topGap[l] >= g) {
+                    shellSortBatchGapScalar(soa, length, laneGaps[l][g], l, compares);
+                }
+            }
+            continue;
+        }
+        
+        I64 gap = laneGaps[0][g];
+#if SHELLSORT_X86_SIMD
+        if (simdLevel >= 2) {
+            shellSortBatchGapAvx512(soa, length, gap, compares);
+            continue;
+        }
+        if (simdLevel >= 1) {
+            shellSortBatchGapAvx2(soa, length, gap, compares);
+            continue;
+        }
+#endif
+        for (I64 l = 0; l < lanes; l++) {
+            shellSortBatchGapScalar(soa, length, gap, l, compares);
+        }
+    }
+}
+
+// fisher yates shuffle of one lane of an interleaved batch, consumes the same random numbers as shuffleArray
+void shuffleBatchLane(int soa[], I64 length, I64 lane) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    for (I64 i = length-1; i > 0; i--) {
+        I64 j = rand_pcg_u32_bounded((U32)(i+1));
+        swapInts(&soa[i * lanes + lane], &soa[j * lanes + lane]);
+    }
+}
+
+int isBatchLaneSorted(int const soa[], I64 length, I64 lane) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    for (I64 i = 1; i < length; i++) {
+        if (soa[i * lanes + lane] <= soa[(i-1) * lanes + lane]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static const I64 gaps_blaazen[] = {1, 4, 10, 23, 57, 132, 301, 701, 1559, 3463, 7703, 17099, 37957, 83459, 185267, 411211, 912871, 2026567, 4498951, 9987709, 22172701, 49223393, 109275931, 242592563, 538555487, -1};
+// ciura's gap sequence 1, ..., 701, extended using blaazen's prime numbers 1559, 3463, ..., 49223393 found at https://forum.lazarus.freepascal.org/index.php?topic=52551.0
+// I extended further starting with 109275931, ...
+// all of blaazen's gaps after 701 are prime, ratios are approx: 2.223, 2.221, 2.224, 2.2197, 2.2198, 2.198, 2.2198, 2.2195, 2.21995, 2.219992, 2.21998, 2.220008, 2.219998, 2.2199998
+
+
+// computed experimentally for minimizing compares, arraySize~=lastGap*8000/301, with 2 extra gaps with randRatio in [2.2,2.8] then [2.3,3.2]
+// has ratios: 4.000, 2.500, 2.300, 2.478, 2.316, 2.280, 2.329, 2.334, 2.237, 2.222, 2.229, 2.227, 2.209, 2.219, 2.242, 2.195, 2.190, 2.203, 2.241, 2.197, 2.22, 2.22, ...
+static const I64 gaps_dokken5_222f[] = {1, 4, 10, 23, 57, 132, 301, 701, 1636, 3659, 8129, 18118, 40354, 89129, 197803, 443557, 973657, 2131981, 4697153, 10528127, 23135351, 51360479, 114020263, 253124983, 561937462, 1247501165, 2769452586, 6148184740, -1};
+static const I64 gaps_dokken5_last[] = {1, 5, 14, 27, 80, 199, 479, 1059, 2337, 5453, 12135, 27039, 59972, 132777, 296204, 657169, 1440770, 3164528, 7032227, 15606790, 33962508, 73189213, -1};// experimentally computed for [1, 5, ..., 2337], then computed as [5453=sqrt(3659*8129), ..., 33962508=sqrt(23135351*49856687)] then computed [73189213=(49856687/23135351)^(3/2)*23135351]
+static const I64 gaps_dokken5_222f_time[] = {1, 10, 57, 301, 1636, 8129, 40354, 197803, 973657, 4697153, 23135351, 114020263, 561937462, 2769452586, -1};// for minimizing time
 
 // computed experimentally for minimizing compares, arraySize~=lastGap*8000/301, with 2 extra gaps with randRatio in [2.4,2.9] then [2.6,3.3]
 // has ratios: 4.000, 2.500, 2.300, 2.478, 2.316, 2.280, 2.329, 2.198, 2.270, 2.201, 2.213, 2.220, 2.165, 2.191, 2.189, 2.185, 2.194, 2.167, 2.206, 2.197, 2.22, 2.22, 2.22, 2.22, 2.22
@@ -479,10 +1027,7 @@ static const I64 gaps_dokken5_222f_time[] = {1, 10, 57, 301, 1636, 8129, 40354,
 static const I64  gaps_dokken11_222f[] = {1, 4, 10, 23, 57, 132, 301, 701, 1541, 3498, 7699, 17041, 37835, 81907, 179433, 392867, 858419, 1883473, 4081849, 9002887, 19782319, 43916748, 97495180, 216439299, 480495243, 1066699439, 2368072754, 5257121513, 11670809758, -1};
 static const I64  gaps_dokken11_222f_time[] = {1, 10, 57, 301, 1541, 7699, 37835, 179433, 858419, 4081849, 19782319, 97495180, 480495243, 2368072754, 11670809758, -1};// for minimizing time
 
-// computed experimentally for minimizing compares, arraySize~=lastGap*8000/301, with 2 extra gaps with randRatio in [2.5,2.9] then [2.7,3.3]
-// has ratios: 4.000, 2.500, 2.300, 2.478, 2.316, 2.280, 2.329, 2.146, 2.170, 2.205, 2.216, 2.172, 2.148, 2.177, 2.142, 2.149, 2.145, 2.154, 2.157, 2.143, 2.22, 2.22, 2.22, 2.22, 2.22
-// experimentally computed until 15933053, then extending with constant ratio 2.22 rounded down to nearest integer
-static const I64 gaps_dokken12_222f[] = {1, 4, 10, 23, 57, 132, 301, 701, 1504, 3263, 7196, 15948, 34644, 74428, 162005, 347077, 745919, 1599893, 3446017, 7434649, 15933053, 35371377, 78524456, 174324292, 386999928, 859139840, 1907290444, 4234184785, 9399890222, -1};
+// gaps_dokken12_222f is in shellsort_engine.h, the file sort tool uses it too
 static const I64 gaps_dokken12_222f_time[] = {1, 10, 57, 301, 1504, 7196, 34644, 162005, 745919, 3446017, 15933053, 78524456, 386999928, 1907290444, 9399890222, -1};// for minimizing time
 
 // computed experimentally for minimizing time when sorting arrays of roughly 400 or less elements
@@ -514,6 +1059,8 @@ static const I64 gaps_hibbard1963[] = {1, 3, 7, 15, 31, 63, 127, 255, 511, 1023,
 
 static const I64 gaps_pratt1971[] = {1,2,3,4,6,8,9,12,16,18,24,27,32,36,48,54,64,72,81,96,108,128,144,162,192,216,243,256,288,324,384,432,486,512,576,648,729,768,864,972,1024,1152,1296,1458,1536,1728,1944,2048,2187,2304,2592,2916,3072,3456,3888,4096,4374,4608,5184,5832,6144,6561,6912,7776,8192,8748,9216,10368,11664,12288,13122,13824,15552,16384,17496,18432,19683,20736,23328,24576,26244,27648,31104,32768,34992,36864,39366,41472,46656,49152,52488,55296,59049,62208,65536,69984,73728,78732,82944,93312,98304,104976,110592,118098,124416,131072,139968,147456,157464,165888,177147,186624,196608,209952,221184,236196,248832,262144,279936,294912,314928,331776,354294,373248,393216,419904,442368,472392,497664,524288,531441,559872,589824,629856,663552,708588,746496,786432,839808,884736,944784,995328,1048576,1062882,1119744,1179648,1259712,1327104,1417176,1492992,1572864,1594323,1679616,1769472,1889568,1990656,2097152,2125764,2239488,2359296,2519424,2654208,2834352,2985984,3145728,3188646,3359232,3538944,3779136,3981312,4194304,4251528,4478976,4718592,4782969,5038848,5308416,5668704,5971968,6291456,6377292,6718464,7077888,7558272,7962624,8388608,8503056,8957952,9437184,9565938,10077696,10616832,11337408,11943936,12582912,12754584,13436928,14155776,14348907,15116544,15925248,16777216,17006112,17915904,18874368,19131876,20155392,21233664,22674816,23887872,25165824,25509168,26873856,28311552,28697814,30233088,31850496,33554432,34012224,35831808,37748736,38263752,40310784,42467328,43046721,45349632,47775744,50331648,51018336,53747712,56623104,57395628,60466176,63700992,67108864,68024448,71663616,75497472,76527504,80621568,84934656,86093442,90699264,95551488,100663296,102036672,107495424,113246208,114791256,120932352,127401984,129140163,134217728,136048896,143327232,150994944,153055008,161243136,169869312,172186884,181398528,191102976,201326592,204073344,214990848,226492416,229582512,241864704,254803968,258280326,268435456,272097792,286654464,301989888,306110016,322486272,339738624,344373768,362797056,382205952,387420489,402653184,408146688,429981696,452984832,459165024,483729408,509607936,516560652,536870912,544195584,573308928,603979776,612220032,644972544,679477248,688747536,725594112,764411904,774840978,805306368,816293376,859963392,905969664,918330048,967458816, -1};
 // gaps by Pratt, 1971, 3-smooth numbers, numbers of the form 2^i*3^j with i, j >= 0, https://oeis.org/A003586
+// holds every one below 1000000000, so shellSortPrattOblivious can sort up to 1019215872 elements (the next one) with it,
+// longer arrays need gaps from generate3smoothNumbers, the kernel errors out instead of leaving them unsorted
 
 static const I64 gaps_knuth1973[] = {1, 4, 13, 40, 121, 364, 1093, 3280, 9841, 29524, 88573, 265720, 797161, 2391484, 7174453, 21523360, 64570081, 193710244, 581130733, -1};
 // gaps by Knuth, 1973, generated by formula: (3^i-1)/2
@@ -551,6 +1098,135 @@ static const I64 gaps_aphitoriteCiura1636F22344LDE[] = {1, 4, 10, 23, 57, 132, 3
 static const I64 gaps_pcboyAutoLDE[] = {1, 4, 10, 23, 57, 132, 301, 701, 1524, 3385, 7343, 16277, 35245, 77641, 168356, 371037, 826601, 1801365, 3985424, 8636511, 19297925, 42608009, 93923600, 208531231, 468458525, 1019339649, -1};
 // gaps by PCBoy, Dec 2023, https://pastebin.com/u/aphitorite, https://sortingalgos.miraheze.org/wiki/Shellsort, Extending Ciura's gaps with "AutoLDE X2.15-2.25 Coprime Extended gaps", finding larger terms beyond 1B takes considerable computing time
 
+// the same sequences as X-macro lists, X(g, gap) for every index g > 0 from largest to smallest
+// used to generate kernels where every stride is a compile time constant
+#define GAPS_DOKKEN12_222F(X) \
+    X(28, 9399890222LL) X(27, 4234184785LL) X(26, 1907290444LL) X(25, 859139840LL) X(24, 386999928LL) X(23, 174324292LL) \
+    X(22, 78524456LL) X(21, 35371377LL) X(20, 15933053LL) X(19, 7434649LL) X(18, 3446017LL) X(17, 1599893LL) \
+    X(16, 745919LL) X(15, 347077LL) X(14, 162005LL) X(13, 74428LL) X(12, 34644LL) X(11, 15948LL) \
+    X(10, 7196LL) X(9, 3263LL) X(8, 1504LL) X(7, 701LL) X(6, 301LL) X(5, 132LL) \
+    X(4, 57LL) X(3, 23LL) X(2, 10LL) X(1, 4LL)
+#define GAPS_DOKKEN_FAST4(X) X(1, 27LL)
+#define GAPS_DOKKEN_FAST4_LAST(X) X(2, 185LL) X(1, 38LL)
+
+// one h-pass with a constant gap, always inlined so the compiler can strength reduce the index math
+static inline __attribute__((always_inline)) void shellSortFixedPass(int array[], I64 length, const I64 gap) {
+    for (I64 i = gap; i < length; i++) {
+        int temp = array[i];
+        I64 j = i;
+        while (j >= gap && array[j-gap] > temp) {
+            array[j] = array[j-gap];
+            j -= gap;
+        }
+        array[j] = temp;
+    }
+}
+
+#define SHELLSORT_FIXED_SELECT(g, lastGap) if ((lastGap) < length && level < (g)) level = (g);
+#define SHELLSORT_FIXED_FIRST(g, lastGap) case (g): shellSortFixedPass(array, length, (lastGap)); break;
+// marks an intended fall through to the next case, comments are gone by the time a macro expands so -Wimplicit-fallthrough can't see them
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define SHELLSORT_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef SHELLSORT_FALLTHROUGH
+#define SHELLSORT_FALLTHROUGH
+#endif
+
+#define SHELLSORT_FIXED_REST(g, gap) case (g)+1: shellSortFixedPass(array, length, (gap)); SHELLSORT_FALLTHROUGH;// to the next smaller gap
+
+// defines void name(int array[], I64 length), same passes as shellSortCustomWithLastGapsUncounted(array, length, gaps, lastGaps)
+// the first switch does the lastGaps pass, the second falls through the remaining gaps, then an insertion sort does gap 1
+#define SHELLSORT_FIXED_KERNEL(name, GAPS, LASTGAPS) \
+void name(int array[], I64 length) { \
+    I64 level = 0; \
+    LASTGAPS(SHELLSORT_FIXED_SELECT) \
+    switch (level) { \
+        LASTGAPS(SHELLSORT_FIXED_FIRST) \
+        default: break; \
+    } \
+    switch (level) { \
+        GAPS(SHELLSORT_FIXED_REST) \
+        default: break; \
+    } \
+    insertionSortUncounted(array, length); \
+}
+
+SHELLSORT_FIXED_KERNEL(shellSortFixed_dokken12_222f, GAPS_DOKKEN12_222F, GAPS_DOKKEN12_222F)
+SHELLSORT_FIXED_KERNEL(shellSortFixed_dokken_fast4, GAPS_DOKKEN_FAST4, GAPS_DOKKEN_FAST4_LAST)
+
+// average-case optimal sequences from the README for each fixed length, X(length, gap4, gap3, gap2, gap1) with unused gaps 0
+// length 46 through 63 use the length 64 sequence without the gaps that are not less than length
+#define FIXED_LENGTH_SEQUENCES(X) \
+    X(2, 0, 0, 0, 0) X(3, 0, 0, 0, 0) X(4, 0, 0, 0, 0) X(5, 0, 0, 0, 0) \
+    X(6, 0, 0, 0, 4) X(7, 0, 0, 0, 5) X(8, 0, 0, 0, 5) X(9, 0, 0, 0, 6) \
+    X(10, 0, 0, 9, 6) X(11, 0, 0, 10, 6) X(12, 0, 0, 0, 5) X(13, 0, 0, 12, 5) \
+    X(14, 0, 0, 13, 5) X(15, 0, 0, 13, 5) X(16, 0, 0, 14, 5) X(17, 0, 0, 15, 6) \
+    X(18, 0, 0, 16, 5) X(19, 0, 0, 13, 4) X(20, 0, 0, 13, 4) X(21, 0, 0, 14, 4) \
+    X(22, 0, 21, 14, 4) X(23, 0, 0, 14, 4) X(24, 0, 23, 13, 4) X(25, 0, 23, 13, 4) \
+    X(26, 0, 25, 14, 4) X(27, 0, 25, 14, 4) X(28, 0, 0, 13, 4) X(29, 0, 0, 13, 4) \
+    X(30, 0, 29, 13, 4) X(31, 0, 0, 13, 4) X(32, 0, 0, 13, 4) X(33, 0, 32, 13, 4) \
+    X(34, 0, 32, 13, 4) X(35, 0, 33, 13, 4) X(36, 0, 33, 13, 4) X(37, 0, 35, 13, 4) \
+    X(38, 0, 36, 13, 4) X(39, 0, 36, 13, 4) X(40, 0, 36, 13, 4) X(41, 0, 36, 13, 4) \
+    X(42, 0, 36, 13, 4) X(43, 0, 37, 13, 4) X(44, 0, 41, 13, 4) X(45, 0, 33, 9, 4) \
+    X(46, 0, 38, 9, 4) X(47, 0, 38, 9, 4) X(48, 0, 38, 9, 4) X(49, 0, 38, 9, 4) \
+    X(50, 0, 38, 9, 4) X(51, 0, 38, 9, 4) X(52, 0, 38, 9, 4) X(53, 0, 38, 9, 4) \
+    X(54, 0, 38, 9, 4) X(55, 0, 38, 9, 4) X(56, 0, 38, 9, 4) X(57, 0, 38, 9, 4) \
+    X(58, 0, 38, 9, 4) X(59, 0, 38, 9, 4) X(60, 0, 38, 9, 4) X(61, 0, 38, 9, 4) \
+    X(62, 0, 38, 9, 4) X(63, 62, 38, 9, 4) X(64, 62, 38, 9, 4)
+
+#define SHELLSORT_FIXED_LENGTH_MAX 64
+
+// always inlined with a constant length and gap, so every loop trip count and chain boundary is known at compile time
+static inline __attribute__((always_inline)) void shellSortFixedLengthPass(int array[], const int length, const int gap) {
+    if (gap <= 0 || gap >= length) return;
+    shellSortFixedPass(array, length, gap);
+}
+
+// branch free version, inserts each element by carrying the smaller value down the whole chain with min and max
+// does more compares than the branchy pass because it never stops early, but has no data dependent branches
+static inline __attribute__((always_inline)) void shellSortFixedLengthPassBranchFree(int array[], const int length, const int gap) {
+    if (gap <= 0 || gap >= length) return;
+    for (int i = gap; i < length; i++) {
+        int temp = array[i];
+        int j = i;
+        for (; j >= gap; j -= gap) {
+            int a = array[j-gap];
+            array[j] = (a > temp) ? a : temp;
+            temp = (a > temp) ? temp : a;
+        }
+        array[j] = temp;
+    }
+}
+
+#define SHELLSORT_FIXED_LENGTH_KERNELS(length, gap4, gap3, gap2, gap1) \
+void shellSortFixedLength##length(int array[]) { \
+    shellSortFixedLengthPass(array, length, gap4); \
+    shellSortFixedLengthPass(array, length, gap3); \
+    shellSortFixedLengthPass(array, length, gap2); \
+    shellSortFixedLengthPass(array, length, gap1); \
+    shellSortFixedLengthPass(array, length, 1); \
+} \
+void shellSortFixedLength##length##BranchFree(int array[]) { \
+    shellSortFixedLengthPassBranchFree(array, length, gap4); \
+    shellSortFixedLengthPassBranchFree(array, length, gap3); \
+    shellSortFixedLengthPassBranchFree(array, length, gap2); \
+    shellSortFixedLengthPassBranchFree(array, length, gap1); \
+    shellSortFixedLengthPassBranchFree(array, length, 1); \
+}
+FIXED_LENGTH_SEQUENCES(SHELLSORT_FIXED_LENGTH_KERNELS)
+
+// indexed by length, entries below 2 are NULL
+#define SHELLSORT_FIXED_LENGTH_ENTRY(length, gap4, gap3, gap2, gap1) [length] = shellSortFixedLength##length,
+#define SHELLSORT_FIXED_LENGTH_ENTRY_BRANCH_FREE(length, gap4, gap3, gap2, gap1) [length] = shellSortFixedLength##length##BranchFree,
+static void (* const shellSortFixedLengthKernels[SHELLSORT_FIXED_LENGTH_MAX+1])(int array[]) = {
+    FIXED_LENGTH_SEQUENCES(SHELLSORT_FIXED_LENGTH_ENTRY)
+};
+static void (* const shellSortFixedLengthKernelsBranchFree[SHELLSORT_FIXED_LENGTH_MAX+1])(int array[]) = {
+    FIXED_LENGTH_SEQUENCES(SHELLSORT_FIXED_LENGTH_ENTRY_BRANCH_FREE)
+};
+
 // from https://ghostproxies.com/sort-b/
 // outputs gap sequence into gaps
 void computeGhostProxiesGaps(I64* gaps, I64 length) {
@@ -605,25 +1281,85 @@ I64 chooseRandomGap(I64 previousGap, double minRatio, double maxRatio) {
     return random_number;
 }
 
+// compare count statistics of a search candidate, or of one worker's share of its samples in a round
 typedef struct {
     I64 count;// total compare count
-    I64 gap;
     I64 sampleCount;
     double mean;// average number of compares per sample, count / sampleCount
     double M2;// sum of squares of differences from the current mean, updated using welford's online algorithm
+    double sortMean;// with ANTITHETIC_SAMPLING a sample is the average of a pair of sorts, mean and M2 of the individual sorts
+    double sortM2;
+}
+SampleStats;
+
+// welford update of everything but count with one more sample value
+static void addSampleValue(SampleStats* stats, double compares) {
+    // update using welford's online algorithm
+    stats->sampleCount += 1;
+    double delta = compares - stats->mean;
+    stats->mean += delta / stats->sampleCount;
+    double delta2 = compares - stats->mean;
+    stats->M2 += delta * delta2;
+}
+
+void addSampleStats(SampleStats* stats, I64 compares) {
+    stats->count += compares;
+    addSampleValue(stats, compares);
+}
+
+// adds an antithetic pair as one sample with the average of its two compare counts, count still totals every sort
+void addAntitheticPairStats(SampleStats* stats, I64 compares, I64 reverseCompares) {
+    stats->count += compares + reverseCompares;
+    addSampleValue(stats, (compares + reverseCompares) / 2.0);
+    
+    I64 numSorts = 2 * stats->sampleCount;
+    double delta = compares - stats->sortMean;
+    stats->sortMean += delta / (numSorts - 1);
+    stats->sortM2 += delta * (compares - stats->sortMean);
+    delta = reverseCompares - stats->sortMean;
+    stats->sortMean += delta / numSorts;
+    stats->sortM2 += delta * (reverseCompares - stats->sortMean);
+}
+
+// folds part into total using chan's parallel formula
+// https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Parallel_algorithm
+void mergeSampleStats(SampleStats* total, SampleStats const* part) {
+    if (part->sampleCount == 0) {
+        return;
+    }
+    I64 n = total->sampleCount + part->sampleCount;
+    double weight = (double)total->sampleCount * part->sampleCount / n;
+    double delta = part->mean - total->mean;
+    total->mean += delta * part->sampleCount / n;
+    total->M2 += part->M2 + delta * delta * weight;
+    double sortDelta = part->sortMean - total->sortMean;
+    total->sortMean += sortDelta * part->sampleCount / n;
+    total->sortM2 += part->sortM2 + sortDelta * sortDelta * 2 * weight;// two sorts per sample
+    total->count += part->count;
+    total->sampleCount = n;
+}
+
+// unbiased variance of a candidate's compare counts
+double sampleVariance(SampleStats const* stats) {
+    return stats->M2 / (stats->sampleCount - 1);
+}
+
+typedef struct {
+    I64 gap;
+    SampleStats stats;
 }
 GapAndCount;
 
 int compareGapAndCount(const void* a, const void* b) {
     //COMPARE_COUNTER++;
-    if (((GapAndCount*)a)->count < ((GapAndCount*)b)->count) {
+    if (((GapAndCount*)a)->stats.count < ((GapAndCount*)b)->stats.count) {
         return -1;
     }
-    else if (((GapAndCount*)a)->count > ((GapAndCount*)b)->count) {
+    else if (((GapAndCount*)a)->stats.count > ((GapAndCount*)b)->stats.count) {
         return 1;
     }
     return 0;
-    //return (int)(((GapAndCount*)a)->count - ((GapAndCount*)b)->count);
+    //return (int)(((GapAndCount*)a)->stats.count - ((GapAndCount*)b)->stats.count);
 }
 
 I64 gcd(I64 a, I64 b) {
@@ -674,61 +1410,412 @@ void extendGapsWithRatioFloor(const I64 gaps[], double ratio, I64 newGaps[]) {
     newGaps[i] = -1;
 }
 
-// computes a "good" lastGaps sequence corresponding to passed in gaps
-// uses precomputed good last gaps while following ciura+1504+3263 gaps 1, 4, ..., 701, 1504, 3263
-// otherwise uses geometric mean
-// output in lastGaps
-// assumes gaps ends in -1 or any negative number
-// assumes length of lastGaps is as long as input gaps, but not more than 32 long
-// will put -1 at end of lastGaps sequence
-void computeGoodLastGaps(const I64 gaps[], I64 lastGaps[]) {
-    lastGaps[0] = 1;
+// computeGoodLastGaps is in shellsort_engine.h
+
+// 3-smooth numbers (2^i * 3^j) below limit in increasing order, for the pratt gap sequence
+// merges the streams 2*x and 3*x over the numbers found so far, so every output costs O(1) instead of trial dividing every k
+// writes at most maxCount of them followed by -1 (numbers needs room for maxCount+1), returns how many were written
+I64 generate3smoothNumbers(I64 numbers[], I64 maxCount, I64 limit) {
+    I64 count = 0;
+    if (maxCount >= 1 && limit > 1) {
+        numbers[count++] = 1;
+    }
+    I64 i2 = 0;// next number to multiply by 2
+    I64 i3 = 0;// next number to multiply by 3
+    while (count > 0 && count < maxCount) {
+        I64 next2 = 2 * numbers[i2];
+        I64 next3 = 3 * numbers[i3];
+        I64 next = next2 < next3 ? next2 : next3;
+        if (next >= limit) {
+            break;
+        }
+        numbers[count++] = next;
+        if (next2 == next) {
+            i2++;
+        }
+        if (next3 == next) {
+            i3++;
+        }
+    }
+    numbers[count] = -1;
+    return count;
+}
+
+// compute 3-smooth numbers for pratt gap sequence
+void print3smoothNumbers(void) {
+    I64 numbers[1024];
+    I64 count = generate3smoothNumbers(numbers, 1023, 1000000000);
+    for (I64 i = 0; i < count; i++) {
+        printf("%lld,", numbers[i]);
+    }
+    printf("\n");
+}
+
+// registry of the gap sequences above for the bake-off, each one is a static table or a generator for a given array length
+#define GAP_SEQUENCE_MAX_GAPS 1024 // room a generator may use, including the -1
+
+typedef void (*GapSequenceGenerator)(I64 gaps[], I64 length);// writes gaps for sorting length elements, starting with 1 and ending with -1
+
+typedef struct {
+    const char* name;
+    const I64* gaps;// static table, NULL if generated
+    const I64* lastGaps;// largest gap table to use with gaps (shellSortCustomWithLastGaps), NULL to use gaps
+    GapSequenceGenerator generate;// used when gaps is NULL
+    I64 maxLength;// longest array the sequence was made for, 0 if unlimited
+} GapSequence;
+
+// ciura's 2001 gaps extended with ratio 2.25 rounded down
+static void generateCiura2001Floor225(I64 gaps[], I64 length) {
+    (void)length;
+    static const I64 ciura2001[] = {1, 4, 10, 23, 57, 132, 301, 701, -1};
+    extendGapsWithRatioFloor(ciura2001, 2.25, gaps);
+}
+
+// pratt's 3-smooth numbers below length
+static void generatePratt3smooth(I64 gaps[], I64 length) {
+    generate3smoothNumbers(gaps, GAP_SEQUENCE_MAX_GAPS - 1, length > 2 ? length : 2);
+}
+
+static const GapSequence GAP_SEQUENCES[] = {
+    {"dokken12_222f", gaps_dokken12_222f, NULL, NULL, 0},
+    {"dokken12_222f_time", gaps_dokken12_222f_time, NULL, NULL, 0},
+    {"dokken11_222f", gaps_dokken11_222f, NULL, NULL, 0},
+    {"dokken11_222f_time", gaps_dokken11_222f_time, NULL, NULL, 0},
+    {"dokken5_222f", gaps_dokken5_222f, gaps_dokken5_last, NULL, 0},
+    {"dokken5_222f_time", gaps_dokken5_222f_time, NULL, NULL, 0},
+    {"dokken_fast4", gaps_dokken_fast4, gaps_dokken_fast4_last, NULL, 400},
+    {"blaazen", gaps_blaazen, NULL, NULL, 0},
+    {"swenson", gaps_swenson, NULL, NULL, 0},
+    {"ciura225odd", gaps_ciura225odd, NULL, NULL, 0},
+    {"ciura2001_floor225", NULL, NULL, generateCiura2001Floor225, 0},
+    {"skean2023", gaps_skean2023, NULL, NULL, 0},
+    {"skean2023A1000Time", gaps_skean2023A1000Time, NULL, NULL, 0},
+    {"lee2021", gaps_lee2021, NULL, NULL, 0},
+    {"tokuda1992", gaps_tokuda1992, NULL, NULL, 0},
+    {"hibbard1963", gaps_hibbard1963, NULL, NULL, 0},
+    {"pratt1971", NULL, NULL, generatePratt3smooth, 0},
+    {"knuth1973", gaps_knuth1973, NULL, NULL, 0},
+    {"sedgewick1986", gaps_sedgewick1986, NULL, NULL, 0},
+    {"sedgewick1982", gaps_sedgewick1982, NULL, NULL, 0},
+    {"incerpi1985", gaps_incerpi1985, NULL, NULL, 0},
+    {"baobao", gaps_baobao, NULL, NULL, 0},
+    {"aphitoriteC23601", gaps_aphitoriteC23601, NULL, NULL, 0},
+    {"aphitoriteC214399", gaps_aphitoriteC214399, NULL, NULL, 0},
+    {"aphitoriteSplitRatio", gaps_aphitoriteSplitRatio, NULL, NULL, 0},
+    {"aphitoriteCiura1636F22344", gaps_aphitoriteCiura1636F22344, NULL, NULL, 0},
+    {"aphitoriteCiura1636F22344LDE", gaps_aphitoriteCiura1636F22344LDE, NULL, NULL, 0},
+    {"pcboyAutoLDE", gaps_pcboyAutoLDE, NULL, NULL, 0},
+    {"ghostProxies", NULL, NULL, computeGhostProxiesGaps, 0},
+};
+#define NUM_GAP_SEQUENCES ((I64)(sizeof(GAP_SEQUENCES) / sizeof(GAP_SEQUENCES[0])))
+
+// returns NULL if no sequence has that name
+const GapSequence* findGapSequence(const char* name) {
+    for (I64 i = 0; i < NUM_GAP_SEQUENCES; i++) {
+        if (strcmp(GAP_SEQUENCES[i].name, name) == 0) {
+            return &GAP_SEQUENCES[i];
+        }
+    }
+    return NULL;
+}
+
+// gaps of sequence for sorting length elements, generated into storage (GAP_SEQUENCE_MAX_GAPS long) if it isn't a table
+const I64* gapSequenceGaps(const GapSequence* sequence, I64 length, I64 storage[]) {
+    if (sequence->gaps != NULL) {
+        return sequence->gaps;
+    }
+    sequence->generate(storage, length);
+    return storage;
+}
+
+typedef struct {
+    I64 sequenceIndex;
+    I64 length;
+    I64 numSamples;
+    double meanCompares;// per sort
+    double compareVariance;
+    double meanTime;// ns per element, over batches
+    double timeVariance;
+} BakeOffResult;
+
+typedef struct {
+    BakeOffResult* results;
+    I64 numResults;
+    I64 nextResult;
+    U64 seed;
+} BakeOffContext;
+
+// pool job, claims (sequence, length) pairs until none are left and counts their compares, timing is done by timeBakeOffLength
+// sample k of every pair is shuffled from the same seed, so all sequences sort the same arrays and a rerun reproduces the counts
+static void bakeOffJob(void* context_, I64 threadNum) {
+    (void)threadNum;
+    BakeOffContext* context = context_;
+    I64 gapStorage[GAP_SEQUENCE_MAX_GAPS];
+    while (1) {
+        I64 r = __atomic_fetch_add(&context->nextResult, 1, __ATOMIC_RELAXED);
+        if (r >= context->numResults) {
+            break;
+        }
+        BakeOffResult* result = &context->results[r];
+        const GapSequence* sequence = &GAP_SEQUENCES[result->sequenceIndex];
+        I64 N = result->length;
+        const I64* gaps = gapSequenceGaps(sequence, N, gapStorage);
+        const I64* lastGaps = sequence->lastGaps != NULL ? sequence->lastGaps : gaps;
+        
+        int* array = malloc(sizeof(int) * N);
+        initializeArray(array, N);
+        
+        double meanCompares = 0;
+        double M2Compares = 0;
+        for (I64 k = 0; k < result->numSamples; k++) {
+            srand_pcg_sample(context->seed, 0, k);// array is sorted before every shuffle, so sample k is the same permutation everywhere
+            shuffleArray(array, N);
+            double compares = shellSortCustomWithLastGapsCounted(array, N, gaps, lastGaps);
+            double delta = compares - meanCompares;
+            meanCompares += delta / (k + 1);
+            M2Compares += delta * (compares - meanCompares);
+        }
+        if (!isArraySorted(array, N)) {
+            printf("error 1915\n");
+            exit(1);
+        }
+        result->meanCompares = meanCompares;
+        result->compareVariance = result->numSamples > 1 ? M2Compares / (result->numSamples - 1) : 0;
+        
+        free(array);
+    }
+}
+
+// times the pairs results[0..numResults), all of one length, on the calling thread while nothing else of the bake-off runs,
+// so no sort shares the caches or memory bandwidth with another one
+// batches go round robin over the sequences, so clock speed drift or background load during the run hits every sequence alike,
+// and batch b sorts the same shuffles for every sequence, time is per batch of numSamples/numBatches sorts to stay well above the timer resolution
+static void timeBakeOffLength(BakeOffResult results[], I64 numResults, I64 numBatches, U64 seed) {
+    I64 N = results[0].length;
+    I64 samplesPerBatch = results[0].numSamples / numBatches;
+    int* array = malloc(sizeof(int) * N);
+    int* arrayTimed = malloc(sizeof(int) * N);
+    double* M2Time = calloc(numResults, sizeof(double));
+    I64 gapStorage[GAP_SEQUENCE_MAX_GAPS];
+    initializeArray(array, N);
+    for (I64 q = 0; q < numResults; q++) {
+        results[q].meanTime = 0;
+    }
     
-    static const I64 precomputedGaps[] =     {1, 4, 10, 23, 57, 132, 301,  701, 1504, 3263};
-    static const I64 precomputedLastGaps[] = {1, 5, 14, 27, 80, 199, 479, 1059, 2337};
+    for (I64 b = 0; b < numBatches; b++) {
+        for (I64 q = 0; q < numResults; q++) {
+            const GapSequence* sequence = &GAP_SEQUENCES[results[q].sequenceIndex];
+            const I64* gaps = gapSequenceGaps(sequence, N, gapStorage);
+            const I64* lastGaps = sequence->lastGaps != NULL ? sequence->lastGaps : gaps;
+            U64 batchTime = 0;
+            for (I64 i = 0; i < samplesPerBatch; i++) {
+                srand_pcg_sample(seed, 0, b * samplesPerBatch + i);// same permutations as the compare counts
+                shuffleArray(array, N);
+                copyArray(array, arrayTimed, N);
+                
+                U64 startTime = currentTime();
+                shellSortCustomWithLastGapsUncounted(arrayTimed, N, gaps, lastGaps);
+                batchTime += currentTime() - startTime;
+                
+                copyArray(arrayTimed, array, N);// sorted again for the next shuffle
+            }
+            if (!isArraySorted(array, N)) {
+                printf("error 2184\n");
+                exit(1);
+            }
+            double time = batchTime * 1000.0 / samplesPerBatch / N;
+            double delta = time - results[q].meanTime;
+            results[q].meanTime += delta / (b + 1);
+            M2Time[q] += delta * (time - results[q].meanTime);
+        }
+    }
+    for (I64 q = 0; q < numResults; q++) {
+        results[q].timeVariance = numBatches > 1 ? M2Time[q] / (numBatches - 1) : 0;
+    }
     
-    I64 numPrecomputed = sizeof(precomputedLastGaps) / sizeof(I64);
+    free(M2Time);
+    free(arrayTimed);
+    free(array);
+}
+
+static int compareBakeOffResults(const void* a, const void* b) {
+    const BakeOffResult* x = a;
+    const BakeOffResult* y = b;
+    if (x->length != y->length) {
+        return (x->length > y->length) - (x->length < y->length);
+    }
+    return (x->meanCompares > y->meanCompares) - (x->meanCompares < y->meanCompares);
+}
+
+// runs every registered sequence on every length in sizes and prints one leaderboard per length, best compares first
+// about elementsPerRun elements are sorted per (sequence, length), in numBatches batches, spread over numThreads threads
+// intervals are 95% (1.96 standard errors), time intervals come from the spread between batches
+// compares are counted on numThreads threads, the timed sorts then run one at a time with the pool gone (see timeBakeOffLength),
+// so the ns/element column only measures contention from outside the program
+void runGapSequenceBakeOff(const I64 sizes[], int numSizes, I64 elementsPerRun, I64 numBatches, I64 numThreads, U64 seed) {
+    BakeOffResult* results = malloc(sizeof(BakeOffResult) * NUM_GAP_SEQUENCES * numSizes);
+    I64 numResults = 0;
+    for (int s = 0; s < numSizes; s++) {
+        for (I64 q = 0; q < NUM_GAP_SEQUENCES; q++) {
+            if (GAP_SEQUENCES[q].maxLength != 0 && sizes[s] > GAP_SEQUENCES[q].maxLength) {
+                continue;
+            }
+            I64 numSamples = elementsPerRun / sizes[s];
+            numSamples = (numSamples + numBatches - 1) / numBatches * numBatches;
+            if (numSamples < numBatches) {
+                numSamples = numBatches;// lengths above elementsPerRun still get one sort per batch
+            }
+            BakeOffResult result = {q, sizes[s], numSamples, 0, 0, 0, 0};
+            results[numResults++] = result;
+        }
+    }
     
-    I64 i = 1;
-    while (i < numPrecomputed && gaps[i] == precomputedGaps[i] && gaps[i+1] == precomputedGaps[i+1]) {
-        lastGaps[i] = precomputedLastGaps[i];
-        i++;
+    // longest arrays first so the slowest pairs don't end up last on one thread
+    BakeOffContext context = {results, numResults, 0, seed};
+    for (I64 i = 0; i < numResults / 2; i++) {
+        BakeOffResult temp = results[i];
+        results[i] = results[numResults - 1 - i];
+        results[numResults - 1 - i] = temp;
     }
+    ShellSortPool* pool = shellSortPoolCreate(numThreads);
+    shellSortPoolRun(pool, bakeOffJob, &context, numThreads);
+    shellSortPoolDestroy(pool);
     
-    while (gaps[i] >= 0 && i < 32) {
-        double g;
-        if (gaps[i+1] >= 0) {
-            g = sqrt(gaps[i] * (double)gaps[i+1]);
-        }
-        else {
-            g = pow(gaps[i], 1.5) / sqrt(gaps[i-1]);
+    qsort(results, numResults, sizeof(BakeOffResult), compareBakeOffResults);
+    for (I64 i = 0, j = 0; i < numResults; i = j) {
+        while (j < numResults && results[j].length == results[i].length) {
+            j++;
         }
-        
-        lastGaps[i] = g;
-        i++;
+        timeBakeOffLength(&results[i], j - i, numBatches, seed);
     }
-    if (i >= 32) {
-        printf("error 1255, maybe gaps are too long or do not end with -1\n");
-        exit(1);
+    for (I64 i = 0; i < numResults; i++) {
+        BakeOffResult* result = &results[i];
+        I64 N = result->length;
+        if (i == 0 || results[i-1].length != N) {
+            printf("\nN = %lld, %lld samples, seed %llu\n", N, result->numSamples, seed);
+            printf("     %-30s %24s %24s\n", "sequence", "compares/element", "ns/element");
+        }
+        I64 rank = 1;
+        while (i - rank >= 0 && results[i - rank].length == N) {
+            rank++;
+        }
+        double compareInterval = 1.96 * sqrt(result->compareVariance / result->numSamples);
+        double timeInterval = 1.96 * sqrt(result->timeVariance / numBatches);
+        printf("%3lld. %-30s %12.4f +- %8.4f %14.2f +- %6.2f\n", rank, GAP_SEQUENCES[result->sequenceIndex].name,
+               result->meanCompares / N, compareInterval / N, result->meanTime, timeInterval);
     }
-    lastGaps[i] = -1;
+    free(results);
 }
 
-// compute 3-smooth numbers for pratt gap sequence
-void print3smoothNumbers(void) {
-    for (int k = 1; k < 1000000000; k++) {
-        int i = k;
-        while (i % 2 == 0) {
-            i = i / 2;
+// qsort_r style shell sort for callers with expensive comparators
+// uses gaps_dokken12_222f with computeGoodLastGaps, which minimizes compares rather than time
+// cmp gets (a, b, ctx) in glibc qsort_r order and returns negative, 0 or positive, the sort is not stable
+
+#define SHELLSORT_R_INDIRECT_MIN_SIZE 64 // larger elements are sorted through an array of pointers and moved once at the end
+
+typedef int (*ShellSortCompare_r)(const void*, const void*, void*);
+
+typedef struct {
+    ShellSortCompare_r cmp;
+    void* ctx;
+} ShellSortIndirectContext;
+
+static int shellSortIndirectCompare(const void* a, const void* b, void* ctx) {
+    ShellSortIndirectContext* indirect = ctx;
+    return indirect->cmp(*(void* const*)a, *(void* const*)b, indirect->ctx);
+}
+
+// always inlined into a caller with a constant size, so each memcpy becomes a fixed size load and store
+static inline __attribute__((always_inline)) void shellSortGenericPasses(char* base, I64 length, size_t size, ShellSortCompare_r cmp, void* ctx,
+                                                                         const I64 gaps[], const I64 lastGaps[], char* temp) {
+    // find initial gap (largest gap that is less than length)
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    
+    // same passes as shellSortCustomWithLastGaps, the gap 1 pass is the last iteration instead of a separate insertion sort
+    I64 gap = lastGaps[--g];
+    while (1) {
+        size_t gapBytes = gap * size;
+        for (I64 i = gap; i < length; i++) {
+            char* p = base + i * size;
+            char* q = p - gapBytes;
+            if (cmp(q, p, ctx) <= 0) continue;// already in place, no moves
+            
+            memcpy(temp, p, size);
+            do {
+                memcpy(p, q, size);
+                p = q;
+                if ((size_t)(p - base) < gapBytes) break;
+                q = p - gapBytes;
+            } while (cmp(q, temp, ctx) > 0);
+            memcpy(p, temp, size);
         }
-        while (i % 3 == 0) {
-            i = i / 3;
+        if (g == 0) break;
+        gap = gaps[--g];
+    }
+}
+
+void shellsort_r(void* base, size_t n, size_t size, int (*cmp)(const void*, const void*, void*), void* ctx) {
+    if (n < 2 || size == 0) return;
+    
+    I64 lastGaps[32];
+    computeGoodLastGaps(gaps_dokken12_222f, lastGaps);
+    
+    I64 length = (I64)n;
+    char temp[32];
+    switch (size) {
+        case 4: shellSortGenericPasses(base, length, 4, cmp, ctx, gaps_dokken12_222f, lastGaps, temp); return;
+        case 8: shellSortGenericPasses(base, length, 8, cmp, ctx, gaps_dokken12_222f, lastGaps, temp); return;
+        case 16: shellSortGenericPasses(base, length, 16, cmp, ctx, gaps_dokken12_222f, lastGaps, temp); return;
+        case 32: shellSortGenericPasses(base, length, 32, cmp, ctx, gaps_dokken12_222f, lastGaps, temp); return;
+    }
+    if (size < SHELLSORT_R_INDIRECT_MIN_SIZE) {
+        char* tempLarge = malloc(size);
+        if (tempLarge == NULL) {
+            printf("error 1219\n");
+            exit(1);
         }
-        if (i == 1) {
-            printf("%d,", k);
+        shellSortGenericPasses(base, length, size, cmp, ctx, gaps_dokken12_222f, lastGaps, tempLarge);
+        free(tempLarge);
+        return;
+    }
+    
+    // sort pointers, then apply the permutation one cycle at a time so every element is moved at most once
+    char** pointers = malloc(sizeof(char*) * n);
+    char* tempLarge = malloc(size);
+    if (pointers == NULL || tempLarge == NULL) {
+        printf("error 1231\n");
+        exit(1);
+    }
+    char* bytes = base;
+    for (I64 i = 0; i < length; i++) {
+        pointers[i] = bytes + i * size;
+    }
+    
+    ShellSortIndirectContext indirect = {cmp, ctx};
+    shellSortGenericPasses((char*)pointers, length, sizeof(char*), shellSortIndirectCompare, &indirect, gaps_dokken12_222f, lastGaps, temp);
+    
+    for (I64 i = 0; i < length; i++) {
+        if (pointers[i] == bytes + i * size) continue;
+        memcpy(tempLarge, bytes + i * size, size);
+        I64 j = i;
+        while (1) {
+            char* from = pointers[j];
+            pointers[j] = bytes + j * size;
+            I64 k = (from - bytes) / size;
+            if (k == i) {
+                memcpy(bytes + j * size, tempLarge, size);
+                break;
+            }
+            memcpy(bytes + j * size, from, size);
+            j = k;
         }
     }
-    printf("\n");
+    
+    free(tempLarge);
+    free(pointers);
 }
 
 // test average runtime of different sorting algorithms
@@ -736,6 +1823,7 @@ void testAverageRuntime(void) {
     const I64 N = 512;
     //int array[N];
     int* array = malloc(sizeof(int) * N);
+    int* arrayCounted = malloc(sizeof(int) * N);
     initializeArray(array, N);
     
     I64 numSamples = 1000;// 10000000;
@@ -743,6 +1831,7 @@ void testAverageRuntime(void) {
     U64 totalTime = 0;
     for (I64 i = 0; i < numSamples; i++) {
         shuffleArray(array, N);
+        copyArray(array, arrayCounted, N);
         U64 startTime = currentTime();
         
         //insertionSort(array, N);
@@ -751,11 +1840,14 @@ void testAverageRuntime(void) {
         //mergesort(array, N, sizeof(int), compare_qsort);
         //heapsort(array, N, sizeof(int), compare_qsort);
         
-        shellSortCustom(array, N, gaps_dokken12_222f);
-        //shellSortCustomWithLastGapsMultithreaded(array, N, gaps_dokken11_222f, gaps_dokken11_222f, 5);
+        shellSortCustomUncounted(array, N, gaps_dokken12_222f);
+        //shellSortCustomWithLastGapsMultithreadedUncounted(array, N, gaps_dokken11_222f, gaps_dokken11_222f, 5);
         
         U64 endTime = currentTime();
         totalTime += endTime - startTime;
+        
+        // count compares outside of the timed region with the counted kernel on the same shuffle
+        shellSortCustom(arrayCounted, N, gaps_dokken12_222f);
     }
     printf("numCompares = %lld, %g million compares\n", COMPARE_COUNTER, (COMPARE_COUNTER / 1000000.0));
     printf("time to sort = %llu microseconds, %g seconds\n", totalTime, (totalTime / (double)TICKS_PER_SEC));
@@ -768,15 +1860,699 @@ void testAverageRuntime(void) {
         exit(1);
     }
     
+    free(arrayCounted);
+    free(array);
+}
+
+// compare wall-clock time of the scalar and vectorized uncounted kernels on the same shuffles
+void testSimdRuntime(void) {
+    const I64 sizes[] = {10000, 1000000, 10000000};
+    const I64* tables[] = {gaps_dokken12_222f, gaps_dokken11_222f_time};
+    const char* tableNames[] = {"gaps_dokken12_222f", "gaps_dokken11_222f_time"};
+    int simdLevel = detectSimdLevel();
+    printf("simdLevel = %d (0 = scalar, 1 = AVX2, 2 = AVX-512)\n", simdLevel);
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        I64 numSamples = 100000000 / N;
+        if (numSamples < 3) numSamples = 3;
+        int* array = malloc(sizeof(int) * N);
+        int* arraySimd = malloc(sizeof(int) * N);
+        initializeArray(array, N);
+        
+        for (int t = 0; t < (int)(sizeof(tables) / sizeof(tables[0])); t++) {
+            U64 scalarTime = 0;
+            U64 simdTime = 0;
+            for (I64 i = 0; i < numSamples; i++) {
+                shuffleArray(array, N);
+                copyArray(array, arraySimd, N);
+                
+                U64 startTime = currentTime();
+                shellSortCustomWithLastGapsUncounted(array, N, tables[t], tables[t]);
+                scalarTime += currentTime() - startTime;
+                
+                startTime = currentTime();
+                shellSortCustomWithLastGapsSimdUncounted(arraySimd, N, tables[t], tables[t]);
+                simdTime += currentTime() - startTime;
+                
+                if (memcmp(array, arraySimd, sizeof(int) * N) != 0) {
+                    printf("error 2180\n");
+                    exit(1);
+                }
+            }
+            printf("N = %lld, %s: scalar %.2f ns/element, simd %.2f ns/element, speedup %.2fx\n",
+                   N, tableNames[t],
+                   scalarTime * 1000.0 / numSamples / N, simdTime * 1000.0 / numSamples / N,
+                   scalarTime / (double)simdTime);
+        }
+        
+        free(arraySimd);
+        free(array);
+    }
+}
+
+// time the typed kernels on each of the *_time gap tables, the best table depends on element size
+void testTypedRuntime(void) {
+    const I64 N = 1000000;
+    const I64 numSamples = 20;
+    const I64* tables[] = {gaps_dokken12_222f, gaps_dokken5_222f_time, gaps_dokken11_222f_time, gaps_dokken12_222f_time};
+    const char* tableNames[] = {"gaps_dokken12_222f", "gaps_dokken5_222f_time", "gaps_dokken11_222f_time", "gaps_dokken12_222f_time"};
+    const char* typeNames[] = {"int", "I64", "float", "double", "Record16", "Record32"};
+    const int numTables = (int)(sizeof(tables) / sizeof(tables[0]));
+    const int numTypes = (int)(sizeof(typeNames) / sizeof(typeNames[0]));
+    
+    I64* ranks = malloc(sizeof(I64) * N);
+    int* arrayInt = malloc(sizeof(int) * N);
+    I64* arrayI64 = malloc(sizeof(I64) * N);
+    float* arrayFloat = malloc(sizeof(float) * N);
+    double* arrayDouble = malloc(sizeof(double) * N);
+    Record16* arrayRecord16 = malloc(sizeof(Record16) * N);
+    Record32* arrayRecord32 = malloc(sizeof(Record32) * N);
+    initializeArrayI64(ranks, N);
+    
+    for (int type = 0; type < numTypes; type++) {
+        for (int t = 0; t < numTables; t++) {
+            U64 totalTime = 0;
+            for (I64 i = 0; i < numSamples; i++) {
+                shuffleArrayI64(ranks, N);
+                for (I64 k = 0; k < N; k++) {
+                    arrayInt[k] = (int)ranks[k];
+                    arrayI64[k] = ranks[k];
+                    arrayFloat[k] = (float)ranks[k];
+                    arrayDouble[k] = (double)ranks[k];
+                    arrayRecord16[k].key = ranks[k];
+                    arrayRecord16[k].payload = k;
+                    arrayRecord32[k].key = ranks[k];
+                    arrayRecord32[k].payload[0] = k;
+                }
+                
+                U64 startTime = currentTime();
+                switch (type) {
+                    case 0: shellSortCustomWithLastGapsUncounted(arrayInt, N, tables[t], tables[t]); break;
+                    case 1: shellSortCustomWithLastGapsI64(arrayI64, N, tables[t], tables[t]); break;
+                    case 2: shellSortCustomWithLastGapsFloat(arrayFloat, N, tables[t], tables[t]); break;
+                    case 3: shellSortCustomWithLastGapsDouble(arrayDouble, N, tables[t], tables[t]); break;
+                    case 4: shellSortCustomWithLastGapsRecord16(arrayRecord16, N, tables[t], tables[t]); break;
+                    case 5: shellSortCustomWithLastGapsRecord32(arrayRecord32, N, tables[t], tables[t]); break;
+                }
+                totalTime += currentTime() - startTime;
+            }
+            
+            // every element is a unique rank, so a sorted array holds exactly the ranks in order
+            I64 first = -(N/2);
+            for (I64 k = 0; k < N; k++) {
+                int sorted = 1;
+                switch (type) {
+                    case 0: sorted = arrayInt[k] == (int)(first + k); break;
+                    case 1: sorted = arrayI64[k] == first + k; break;
+                    case 2: sorted = arrayFloat[k] == (float)(first + k); break;
+                    case 3: sorted = arrayDouble[k] == (double)(first + k); break;
+                    case 4: sorted = arrayRecord16[k].key == first + k; break;
+                    case 5: sorted = arrayRecord32[k].key == first + k; break;
+                }
+                if (!sorted) {
+                    printf("error 2290\n");
+                    exit(1);
+                }
+            }
+            printf("N = %lld, %s, %s: %.2f ns/element\n", N, typeNames[type], tableNames[t], totalTime * 1000.0 / numSamples / N);
+        }
+    }
+    
+    free(arrayRecord32);
+    free(arrayRecord16);
+    free(arrayDouble);
+    free(arrayFloat);
+    free(arrayI64);
+    free(arrayInt);
+    free(ranks);
+}
+
+// compare the kernels with baked in gaps against the runtime gap kernel on the same shuffles
+void testFixedRuntime(void) {
+    const I64 sizes[] = {16, 50, 100, 200, 400, 1000, 10000};
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        I64 numSamples = 20000000 / N;
+        int* array = malloc(sizeof(int) * N);
+        int* arrayFixed = malloc(sizeof(int) * N);
+        initializeArray(array, N);
+        
+        for (int t = 0; t < 2; t++) {
+            const I64* gaps = (t == 0) ? gaps_dokken12_222f : gaps_dokken_fast4;
+            const I64* lastGaps = (t == 0) ? gaps_dokken12_222f : gaps_dokken_fast4_last;
+            U64 runtimeTime = 0;
+            U64 fixedTime = 0;
+            for (I64 i = 0; i < numSamples; i++) {
+                shuffleArray(array, N);
+                copyArray(array, arrayFixed, N);
+                
+                U64 startTime = currentTime();
+                shellSortCustomWithLastGapsUncounted(array, N, gaps, lastGaps);
+                runtimeTime += currentTime() - startTime;
+                
+                startTime = currentTime();
+                if (t == 0) {
+                    shellSortFixed_dokken12_222f(arrayFixed, N);
+                }
+                else {
+                    shellSortFixed_dokken_fast4(arrayFixed, N);
+                }
+                fixedTime += currentTime() - startTime;
+                
+                if (memcmp(array, arrayFixed, sizeof(int) * N) != 0) {
+                    printf("error 1517\n");
+                    exit(1);
+                }
+            }
+            printf("N = %lld, %s: runtime gaps %.2f ns/element, fixed gaps %.2f ns/element, speedup %.2fx\n",
+                   N, (t == 0) ? "gaps_dokken12_222f" : "gaps_dokken_fast4",
+                   runtimeTime * 1000.0 / numSamples / N, fixedTime * 1000.0 / numSamples / N,
+                   runtimeTime / (double)fixedTime);
+        }
+        
+        free(arrayFixed);
+        free(array);
+    }
+}
+
+// compare the data oblivious pratt kernel with insertion based shell sort on the same pratt gaps and on gaps_dokken12_222f
+// the oblivious kernel does more compares but has no data dependent branches, so its time per sort barely varies
+void testPrattRuntime(void) {
+    const I64 sizes[] = {16, 64, 256, 1000, 10000, 100000, 1000000};
+    
+    // the generator has to reproduce the table
+    I64 pratt[1024];
+    I64 count = generate3smoothNumbers(pratt, 1023, 1000000000);
+    for (I64 i = 0; i <= count; i++) {
+        if (pratt[i] != gaps_pratt1971[i]) {
+            printf("error 2115\n");
+            exit(1);
+        }
+    }
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        I64 numSamples = 20000000 / N < 1000 ? 20 : 20000000 / N / 50;
+        int* original = malloc(sizeof(int) * N);
+        int* array = malloc(sizeof(int) * N);
+        initializeArray(original, N);
+        
+        const char* names[] = {"pratt oblivious", "pratt insertion", "gaps_dokken12_222f"};
+        U64 times[3] = {0, 0, 0};
+        I64 compares[3] = {0, 0, 0};
+        for (I64 i = 0; i < numSamples; i++) {
+            shuffleArray(original, N);
+            for (int k = 0; k < 3; k++) {
+                copyArray(original, array, N);
+                U64 startTime = currentTime();
+                if (k == 0) {
+                    shellSortPrattObliviousUncounted(array, N, gaps_pratt1971);
+                }
+                else if (k == 1) {
+                    shellSortCustomUncounted(array, N, gaps_pratt1971);
+                }
+                else {
+                    shellSortCustomUncounted(array, N, gaps_dokken12_222f);
+                }
+                times[k] += currentTime() - startTime;
+                if (!isArraySorted(array, N)) {
+                    printf("error 2146\n");
+                    exit(1);
+                }
+                copyArray(original, array, N);
+                if (k == 0) {
+                    compares[k] += shellSortPrattObliviousCounted(array, N, gaps_pratt1971);
+                }
+                else {
+                    compares[k] += shellSortCustomCounted(array, N, (k == 1) ? gaps_pratt1971 : gaps_dokken12_222f);
+                }
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            printf("N = %lld, %-18s %8.2f compares/element, %7.2f ns/element\n", N, names[k],
+                   compares[k] / (double)numSamples / N, times[k] * 1000.0 / numSamples / N);
+        }
+        
+        free(array);
+        free(original);
+    }
+}
+
+// standard bake-off of every registered gap sequence, fixed seed so the leaderboard is reproducible
+void testGapSequenceBakeOff(void) {
+    const I64 sizes[] = {100, 1000, 10000, 100000, 1000000};
+    runGapSequenceBakeOff(sizes, sizeof(sizes) / sizeof(sizes[0]), 20000000, 20, numOnlineCpus(), 12345);
+}
+
+// compare the fixed length kernels with insertionSort and shellSortCustomWithLastGaps using the same gaps, on many small buffers
+void testFixedLengthRuntime(void) {
+    const int sizes[] = {4, 8, 12, 16, 24, 32, 45, 64};
+    const I64 numBuffers = 1024;
+    const I64 numRepeats = 2000;
+    const char* methodNames[] = {"insertionSort", "shellSortCustom", "fixed", "fixed branch free"};
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int N = sizes[s];
+        const I64* gaps;
+        const I64* lastGaps;
+        shellsort_selectGaps(N, &gaps, &lastGaps);
+        int* pool = malloc(sizeof(int) * N * numBuffers);
+        int* work = malloc(sizeof(int) * N * numBuffers);
+        
+        printf("N = %d:", N);
+        for (int method = 0; method < 4; method++) {
+            U64 totalTime = 0;
+            for (I64 r = 0; r < numRepeats; r++) {
+                for (I64 b = 0; b < numBuffers; b++) {
+                    initializeArray(&pool[b*N], N);
+                    shuffleArray(&pool[b*N], N);
+                }
+                copyArray(pool, work, N * numBuffers);
+                
+                U64 startTime = currentTime();
+                for (I64 b = 0; b < numBuffers; b++) {
+                    int* buffer = &work[b*N];
+                    switch (method) {
+                        case 0: insertionSortUncounted(buffer, N); break;
+                        case 1: shellSortCustomWithLastGapsUncounted(buffer, N, gaps, lastGaps); break;
+                        case 2: shellSortFixedLengthKernels[N](buffer); break;
+                        case 3: shellSortFixedLengthKernelsBranchFree[N](buffer); break;
+                    }
+                }
+                totalTime += currentTime() - startTime;
+                
+                for (I64 b = 0; b < numBuffers; b++) {
+                    for (int k = 0; k < N; k++) {
+                        if (work[b*N + k] != k) {
+                            printf("error 1643\n");
+                            exit(1);
+                        }
+                    }
+                }
+            }
+            printf(" %s %.2f ns/sort", methodNames[method], totalTime * 1000.0 / numRepeats / numBuffers);
+        }
+        printf("\n");
+        
+        free(work);
+        free(pool);
+    }
+}
+
+// compare shellSortCustomAdaptive with shellSortCustom on random and presorted inputs, compares and time
+// fails if adaptive does more than 1% extra compares, the time ratio is printed but never fails the test
+// the block shuffled inputs pass the probe at every gap above the block size but still have elements far from home
+void testAdaptiveCompares(void) {
+    const I64 N = 100000;
+    const I64 numSamples = 20;
+    const char* inputNames[] = {"random", "sorted", "reversed", "sorted with 10 swaps", "sorted with 1% swaps", "sorted with random last 1%", "16 sorted runs",
+                                "shuffled within blocks of 1000", "shuffled within blocks of 10000", "shuffled within blocks of 50000"};
+    const I64 blockSizes[] = {1000, 10000, 50000};
+    const int numInputs = (int)(sizeof(inputNames) / sizeof(inputNames[0]));
+    int* array = malloc(sizeof(int) * N);
+    int* arrayAdaptive = malloc(sizeof(int) * N);
+    int* arrayTimed = malloc(sizeof(int) * N);
+    
+    for (int input = 0; input < numInputs; input++) {
+        I64 compares = 0;
+        I64 comparesAdaptive = 0;
+        U64 time = 0;
+        U64 timeAdaptive = 0;
+        for (I64 i = 0; i < numSamples; i++) {
+            initializeArray(array, N);
+            switch (input) {
+                case 0:
+                    shuffleArray(array, N);
+                    break;
+                case 2:
+                    reverseArray(array, N);
+                    break;
+                case 3:
+                case 4: {
+                    I64 numSwaps = (input == 3) ? 10 : N / 100;
+                    for (I64 k = 0; k < numSwaps; k++) {
+                        swapInts(&array[rand_pcg_u32_bounded(N)], &array[rand_pcg_u32_bounded(N)]);
+                    }
+                    break;
+                }
+                case 5:
+                    shuffleArray(&array[N - N/100], N/100);
+                    for (I64 k = N - N/100; k < N; k++) {
+                        array[k] = rand_pcg_u32_bounded(N);
+                    }
+                    break;
+                case 6:
+                    shuffleArray(array, N);
+                    for (I64 k = 0; k < 16; k++) {
+                        insertionSortUncounted(&array[k * (N/16)], (k == 15) ? N - 15 * (N/16) : N/16);
+                    }
+                    break;
+                case 7:
+                case 8:
+                case 9: {
+                    I64 blockSize = blockSizes[input - 7];
+                    for (I64 k = 0; k < N; k += blockSize) {
+                        shuffleArray(&array[k], (N - k < blockSize) ? N - k : blockSize);
+                    }
+                    break;
+                }
+            }
+            copyArray(array, arrayAdaptive, N);
+            
+            copyArray(array, arrayTimed, N);
+            U64 startTime = currentTime();
+            shellSortCustomUncounted(arrayTimed, N, gaps_dokken12_222f);
+            time += currentTime() - startTime;
+            copyArray(array, arrayTimed, N);
+            startTime = currentTime();
+            shellSortCustomAdaptiveUncounted(arrayTimed, N, gaps_dokken12_222f);
+            timeAdaptive += currentTime() - startTime;
+            
+            compares += shellSortCustomCounted(array, N, gaps_dokken12_222f);
+            comparesAdaptive += shellSortCustomAdaptiveCounted(arrayAdaptive, N, gaps_dokken12_222f);
+            
+            if (memcmp(array, arrayAdaptive, sizeof(int) * N) != 0) {
+                printf("error 1706\n");
+                exit(1);
+            }
+        }
+        printf("N = %lld, %s: shellSortCustom %.0f compares, adaptive %.0f compares, ratio %.4f, time ratio %.3f\n", N, inputNames[input],
+               compares / (double)numSamples, comparesAdaptive / (double)numSamples, comparesAdaptive / (double)compares,
+               time > 0 ? timeAdaptive / (double)time : 1.0);
+        if (comparesAdaptive > compares * 1.01) {
+            printf("error 2650\n");
+            exit(1);
+        }
+        // wall clock ratios swing with load and frequency scaling, so a slow run is only reported
+        if (timeAdaptive > time * 1.5 + 1000) {
+            printf("    adaptive took %.3fx the time of shellSortCustom, rerun on an idle machine before reading anything into it\n", timeAdaptive / (double)time);
+        }
+    }
+    
+    free(arrayTimed);
+    free(arrayAdaptive);
     free(array);
 }
 
+// compare shellSortCustomWithLastGapsBlocked with the plain kernel on arrays larger than the cache
+// also reports the main array traffic of the large gap passes: the plain pass loads one element per compare, each a jump of gap*4 bytes,
+// the blocked pass reads and writes every element once in cache line rows
+void testBlockedRuntime(void) {
+    const I64 sizes[] = {10000000, 100000000};
+    const I64* gaps = gaps_dokken12_222f;
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        int* array = malloc(sizeof(int) * N);
+        int* arrayBlocked = malloc(sizeof(int) * N);
+        initializeArray(array, N);
+        shuffleArray(array, N);
+        copyArray(array, arrayBlocked, N);
+        
+        // compare counts, pass by pass for the plain kernel so the large gap passes can be counted separately
+        I64 g = 0;
+        while (gaps[g] < N && gaps[g] > 0) {
+            g++;
+        }
+        I64 compares = 0;
+        I64 largeGapCompares = 0;
+        I64 numLargeGapPasses = 0;
+        for (I64 gap = gaps[--g]; g > 0; gap = gaps[--g]) {
+            I64 passCompares = shellSortSingleGapCounted(array, N, gap);
+            compares += passCompares;
+            if (gap >= SHELLSORT_BLOCKED_MIN_GAP && N / gap >= SHELLSORT_BLOCKED_MIN_CHAIN) {
+                largeGapCompares += passCompares;
+                numLargeGapPasses++;
+            }
+        }
+        compares += insertionSortCounted(array, N);
+        I64 comparesBlocked = shellSortCustomWithLastGapsBlockedCounted(arrayBlocked, N, gaps, gaps);
+        if (compares != comparesBlocked || memcmp(array, arrayBlocked, sizeof(int) * N) != 0) {
+            printf("error 1757\n");
+            exit(1);
+        }
+        
+        // time on the same shuffle
+        shuffleArray(array, N);
+        copyArray(array, arrayBlocked, N);
+        U64 startTime = currentTime();
+        shellSortCustomUncounted(array, N, gaps);
+        U64 plainTime = currentTime() - startTime;
+        startTime = currentTime();
+        shellSortCustomWithLastGapsBlockedUncounted(arrayBlocked, N, gaps, gaps);
+        U64 blockedTime = currentTime() - startTime;
+        if (memcmp(array, arrayBlocked, sizeof(int) * N) != 0) {
+            printf("error 1771\n");
+            exit(1);
+        }
+        
+        printf("N = %lld, %lld compares (same in both), %lld blocked passes\n", N, compares, numLargeGapPasses);
+        printf("    large gap passes: plain %.2f strided loads/element, blocked %.2f sequential bytes/element\n",
+               largeGapCompares / (double)N, 2.0 * sizeof(int) * numLargeGapPasses);
+        printf("    plain %.2f ns/element, blocked %.2f ns/element, speedup %.2fx\n",
+               plainTime * 1000.0 / N, blockedTime * 1000.0 / N, plainTime / (double)blockedTime);
+        
+        free(arrayBlocked);
+        free(array);
+    }
+}
+
+// compare the multithreaded kernel against the single threaded one, output must match for every thread count
+// compares only match up to the final pass, which the multithreaded kernel splits into blocks and boundary fixups
+void testMultithreadedRuntime(void) {
+    const I64 sizes[] = {1000000, 10000000, 100000000};
+    const I64 threadCounts[] = {1, 2, 4, 8};
+    const I64* gaps = gaps_dokken12_222f;
+    printf("online cpus = %lld, parallel min length = %lld\n", numOnlineCpus(), shellSortParallelMinLength());
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        int* original = malloc(sizeof(int) * N);
+        int* array = malloc(sizeof(int) * N);
+        int* arrayThreaded = malloc(sizeof(int) * N);
+        initializeArray(original, N);
+        shuffleArray(original, N);
+        
+        copyArray(original, array, N);
+        U64 startTime = currentTime();
+        shellSortCustomWithLastGapsUncounted(array, N, gaps, gaps);
+        U64 singleTime = currentTime() - startTime;
+        copyArray(original, array, N);
+        I64 compares = shellSortCustomWithLastGapsCounted(array, N, gaps, gaps);
+        
+        printf("N = %lld, %lld compares, single threaded %.2f ns/element\n", N, compares, singleTime * 1000.0 / N);
+        for (int t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); t++) {
+            copyArray(original, arrayThreaded, N);
+            I64 comparesThreaded = shellSortCustomWithLastGapsMultithreadedCounted(arrayThreaded, N, gaps, gaps, threadCounts[t]);
+            if (memcmp(array, arrayThreaded, sizeof(int) * N) != 0) {
+                printf("error 1988\n");
+                exit(1);
+            }
+            copyArray(original, arrayThreaded, N);
+            I64 startCount = COMPARE_COUNTER;
+            shellSortCustomWithLastGapsMultithreaded(arrayThreaded, N, gaps, gaps, threadCounts[t]);
+            if (COMPARE_COUNTER - startCount != comparesThreaded || memcmp(array, arrayThreaded, sizeof(int) * N) != 0) {
+                printf("error 1995\n");
+                exit(1);
+            }
+            
+            copyArray(original, arrayThreaded, N);
+            startTime = currentTime();
+            shellSortCustomWithLastGapsMultithreadedUncounted(arrayThreaded, N, gaps, gaps, threadCounts[t]);
+            U64 threadedTime = currentTime() - startTime;
+            if (memcmp(array, arrayThreaded, sizeof(int) * N) != 0) {
+                printf("error 2004\n");
+                exit(1);
+            }
+            printf("    %lld threads: %lld compares (%.4fx), %.2f ns/element, speedup %.2fx\n",
+                   threadCounts[t], comparesThreaded, comparesThreaded / (double)compares,
+                   threadedTime * 1000.0 / N, singleTime / (double)threadedTime);
+        }
+        
+        free(arrayThreaded);
+        free(array);
+        free(original);
+    }
+}
+
+// compare the multithreaded kernel on a shared array first touched by the main thread and on an interleaved one
+void testNumaPlacement(void) {
+    const I64 N = 100000000;
+    const I64 maxThreads = numOnlineCpus();
+    const I64* gaps = gaps_dokken12_222f;
+    NumaTopology const* topology = numaTopology();
+    printf("%d cpus, %d numa nodes, pinning %d, huge pages %d\n", topology->numCpus, topology->numNodes, PIN_THREADS, USE_HUGE_PAGES);
+    
+    int* original = malloc(sizeof(int) * N);
+    initializeArray(original, N);
+    shuffleArray(original, N);
+    
+    for (int interleaved = 0; interleaved <= 1; interleaved++) {
+        int* array = interleaved ? allocateInterleavedBuffer(sizeof(int) * N) : allocateLargeBuffer(sizeof(int) * N);
+        copyArray(original, array, N);
+        printPagePlacement(interleaved ? "interleaved" : "first touch", array, sizeof(int) * N);
+        
+        U64 startTime = currentTime();
+        shellSortCustomWithLastGapsMultithreadedUncounted(array, N, gaps, gaps, maxThreads);
+        U64 sortTime = currentTime() - startTime;
+        if (!isArraySorted(array, N)) {
+            printf("error 2340\n");
+            exit(1);
+        }
+        printf("    %lld threads: %.2f ns/element\n", maxThreads, sortTime * 1000.0 / N);
+        freeLargeBuffer(array, sizeof(int) * N);
+    }
+    free(original);
+}
+
+// compare the size-aware gaps in shellsort.h against one global sequence, in compares and in time
+void testShellsortLibrary(void) {
+    const I64 sizes[] = {10, 20, 45, 100, 128, 300, 1000, 1500, 7000, 10000, 70000, 100000, 1000000};
+    I64 lastGaps[32];
+    computeGoodLastGaps(gaps_dokken12_222f, lastGaps);
+    
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        I64 N = sizes[s];
+        I64 numSamples = 10000000 / N;
+        if (numSamples > 100000) numSamples = 100000;
+        if (numSamples < 10) numSamples = 10;
+        const I64* gaps;
+        const I64* selectedLastGaps;
+        shellsort_selectGaps(N, &gaps, &selectedLastGaps);
+        
+        int* array = malloc(sizeof(int) * N);
+        int* arrayGlobal = malloc(sizeof(int) * N);
+        int* arrayCounted = malloc(sizeof(int) * N);
+        initializeArray(array, N);
+        
+        I64 compares = 0;
+        I64 comparesGlobal = 0;
+        U64 time = 0;
+        U64 timeGlobal = 0;
+        for (I64 i = 0; i < numSamples; i++) {
+            shuffleArray(array, N);
+            copyArray(array, arrayGlobal, N);
+            copyArray(array, arrayCounted, N);
+            compares += shellSortCustomWithLastGapsCounted(arrayCounted, N, gaps, selectedLastGaps);
+            copyArray(arrayGlobal, arrayCounted, N);
+            comparesGlobal += shellSortCustomWithLastGapsCounted(arrayCounted, N, gaps_dokken12_222f, lastGaps);
+            
+            U64 startTime = currentTime();
+            shellsort_int(array, N);
+            time += currentTime() - startTime;
+            
+            startTime = currentTime();
+            shellSortCustomWithLastGapsUncounted(arrayGlobal, N, gaps_dokken12_222f, lastGaps);
+            timeGlobal += currentTime() - startTime;
+            
+            if (!isArraySorted(array, N) || memcmp(array, arrayGlobal, sizeof(int) * N) != 0) {
+                printf("error 1476\n");
+                exit(1);
+            }
+        }
+        printf("N = %lld: shellsort_int %.3f compares %.2f ns/element, gaps_dokken12_222f %.3f compares %.2f ns/element\n", N,
+               compares / (double)numSamples, time * 1000.0 / numSamples / N,
+               comparesGlobal / (double)numSamples, timeGlobal * 1000.0 / numSamples / N);
+        
+        free(arrayCounted);
+        free(arrayGlobal);
+        free(array);
+    }
+}
+
+// extra work done by the benchmark comparators, models an expensive callback
+static int COMPARE_WORK = 0;
+
+static inline int compareKeysWithWork(const void* a, const void* b) {
+    volatile int sink = 0;
+    for (int k = 0; k < COMPARE_WORK; k++) {
+        sink += k;
+    }
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_qsort_work(const void* a, const void* b) {
+    COMPARE_COUNTER++;
+    return compareKeysWithWork(a, b);
+}
+
+static int compare_shellsort_r_work(const void* a, const void* b, void* ctx) {
+    (*(I64*)ctx)++;
+    return compareKeysWithWork(a, b);
+}
+
+// compare shellsort_r against the libc qsort with the same comparator cost, elements have an int key at offset 0
+void testShellsortRRuntime(void) {
+    const I64 sizes[] = {100, 10000, 1000000};
+    const size_t elementSizes[] = {4, 16, 128};
+    const int works[] = {0, 50};
+    
+    for (int w = 0; w < (int)(sizeof(works) / sizeof(works[0])); w++) {
+        COMPARE_WORK = works[w];
+        for (int e = 0; e < (int)(sizeof(elementSizes) / sizeof(elementSizes[0])); e++) {
+            size_t size = elementSizes[e];
+            for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+                I64 N = sizes[s];
+                I64 numSamples = 10000000 / N / (1 + works[w] / 10);
+                if (numSamples < 1) numSamples = 1;
+                int* ranks = malloc(sizeof(int) * N);
+                char* array = calloc(N, size);
+                char* arrayQsort = malloc(N * size);
+                initializeArray(ranks, N);
+                
+                U64 shellTime = 0;
+                U64 qsortTime = 0;
+                I64 shellCompares = 0;
+                COMPARE_COUNTER = 0;
+                for (I64 i = 0; i < numSamples; i++) {
+                    shuffleArray(ranks, N);
+                    for (I64 k = 0; k < N; k++) {
+                        memcpy(array + k * size, &ranks[k], sizeof(int));
+                    }
+                    memcpy(arrayQsort, array, N * size);
+                    
+                    U64 startTime = currentTime();
+                    shellsort_r(array, N, size, compare_shellsort_r_work, &shellCompares);
+                    shellTime += currentTime() - startTime;
+                    
+                    startTime = currentTime();
+                    qsort(arrayQsort, N, size, compare_qsort_work);
+                    qsortTime += currentTime() - startTime;
+                    
+                    if (memcmp(array, arrayQsort, N * size) != 0) {
+                        printf("error 2362\n");
+                        exit(1);
+                    }
+                }
+                printf("work = %d, size = %zu, N = %lld: shellsort_r %.2f ns/element %.2f compares/element, qsort %.2f ns/element %.2f compares/element, speedup %.2fx\n",
+                       works[w], size, N,
+                       shellTime * 1000.0 / numSamples / N, shellCompares / (double)numSamples / N,
+                       qsortTime * 1000.0 / numSamples / N, COMPARE_COUNTER / (double)numSamples / N,
+                       qsortTime / (double)shellTime);
+                
+                free(arrayQsort);
+                free(array);
+                free(ranks);
+            }
+        }
+    }
+}
+
 // find worst case approximation using a greedy algorithm
 // will not find the absolute worst case
 // can be improved further with findWorstCaseWithRandomMutations
 void findWorstCase(int length, const I64 gaps[]) {
-    int* array = malloc(sizeof(int) * length);
-    int* array2 = malloc(sizeof(int) * length);
+    // values are ranks below length, so U16 keys give the same compare counts with half the memory traffic
+    if (length > (1 << 16)) {
+        printf("error 1121\n");
+        exit(1);
+    }
+    U16* array = malloc(sizeof(U16) * length);
+    U16* array2 = malloc(sizeof(U16) * length);
     
     int middleValue = (length - 1) / 2;
     
@@ -807,12 +2583,11 @@ void findWorstCase(int length, const I64 gaps[]) {
                 continue;
             }
             
-            copyArray(array, array2, length);
+            copyArrayU16(array, array2, length);
             array2[j] = i;
-            COMPARE_COUNTER = 0;
-            shellSortCustom(array2, length, gaps);
-            if (COMPARE_COUNTER > mostCompares || (COMPARE_COUNTER == mostCompares && i < middleValue)) {
-                mostCompares = COMPARE_COUNTER;
+            I64 compares = shellSortCustomCountedU16(array2, length, gaps);
+            if (compares > mostCompares || (compares == mostCompares && i < middleValue)) {
+                mostCompares = compares;
                 indexOfMostCompares = j;
             }
         }
@@ -823,11 +2598,9 @@ void findWorstCase(int length, const I64 gaps[]) {
         }
     }
     
-    printArray(array, length);
-    copyArray(array, array2, length);
-    COMPARE_COUNTER = 0;
-    shellSortCustom(array2, length, gaps);
-    printf("total compares = %lld\n", COMPARE_COUNTER);
+    printArrayU16(array, length);
+    copyArrayU16(array, array2, length);
+    printf("total compares = %lld\n", shellSortCustomCountedU16(array2, length, gaps));
     
     free(array2);
     free(array);
@@ -856,24 +2629,27 @@ void findWorstCaseWithRandomMutations(void) {
     I64 numSamples = 10000000;
     int granularity = 6;// set to 12 to make loss-causing changes very rare, set to 4 to make loss-causing changes more common, or 5,6,7,8 are some good medium values
 
-    int* array = malloc(sizeof(int) * N);
-    initializeArray(array, N);
+    // values are ranks below N, so U16 keys give the same compare counts with half the memory traffic
+    U16* array = malloc(sizeof(U16) * N);
+    initializeArrayU16(array, N);
     
     U64 totalTime = 0;
-    int* array2 = malloc(sizeof(int) * N);
-    int* array3 = malloc(sizeof(int) * N);
-    copyArray(array, array2, N);
-    copyArray(array, array3, N);
+    U16* array2 = malloc(sizeof(U16) * N);
+    U16* array3 = malloc(sizeof(U16) * N);
+    copyArrayU16(array, array2, N);
+    copyArrayU16(array, array3, N);
     I64 highestCompares = 0;
     for (I64 i = 0; i < numSamples; i++) {
         if (highestCompares == 0) {
             if (useInitialArray) {
                 // start with our initial array
-                copyArray(array_initial, array2, N);
+                for (I64 j = 0; j < N; j++) {
+                    array2[j] = (U16)array_initial[j];
+                }
             }
             else {
                 // start with a random array
-                shuffleArray(array2, N);
+                shuffleArrayU16(array2, N);
             }
         }
         else {
@@ -883,14 +2659,14 @@ void findWorstCaseWithRandomMutations(void) {
                 // make a single swap
                 I64 j1 = rand_pcg_u32_bounded(N);
                 I64 j2 = rand_pcg_u32_bounded(N);
-                swapInts(&array2[j1], &array2[j2]);
+                swapU16(&array2[j1], &array2[j2]);
             }
             else if (mutationType == 1) {
                 // make 1 or more swaps
                 do {
                     I64 j1 = rand_pcg_u32_bounded(N);
                     I64 j2 = rand_pcg_u32_bounded(N);
-                    swapInts(&array2[j1], &array2[j2]);
+                    swapU16(&array2[j1], &array2[j2]);
                 }
                 while (rand_pcg_u32() & 1);
             }
@@ -900,8 +2676,8 @@ void findWorstCaseWithRandomMutations(void) {
                 int m = possibleGapsForPairSwaps[rand_pcg_u32_bounded(numGaps)];
                 I64 j1 = rand_pcg_u32_bounded(N-m);
                 I64 j2 = rand_pcg_u32_bounded(N-m);
-                swapInts(&array2[j1], &array2[j2]);
-                swapInts(&array2[j1+m], &array2[j2+m]);
+                swapU16(&array2[j1], &array2[j2]);
+                swapU16(&array2[j1+m], &array2[j2+m]);
             }
             else {
                 // swaps a m-cycle with another m-cycle
@@ -919,19 +2695,17 @@ void findWorstCaseWithRandomMutations(void) {
                 }
                 I64 k_max = k1 > k2 ? k1 : k2;
                 for (I64 j = 0; j+k_max < N; j+=m) {
-                    swapInts(&array2[j+k1], &array2[j+k2]);
+                    swapU16(&array2[j+k1], &array2[j+k2]);
                 }
             }
         }
         
-        copyArray(array2, array, N);
+        copyArrayU16(array2, array, N);
         
         U64 startTime = currentTime();
         
-        I64 saveCompareCounter = COMPARE_COUNTER;
-        shellSortCustom(array, N, gapsToUse);
-        
-        saveCompareCounter = COMPARE_COUNTER - saveCompareCounter;
+        I64 saveCompareCounter = shellSortCustomCountedU16(array, N, gapsToUse);
+        COMPARE_COUNTER += saveCompareCounter;
         
         if (saveCompareCounter >= highestCompares) {
             if (saveCompareCounter > highestCompares) {
@@ -940,68 +2714,348 @@ void findWorstCaseWithRandomMutations(void) {
                 
                 if (useHaltOnCompares && highestCompares >= haltOnCompares) {
                     printf("hit haltOnCompares = %d, stopping\n", haltOnCompares);
-                    printArray(array2, N);
+                    printArrayU16(array2, N);
                     exit(1);
                 }
             }
-            copyArray(array2, array3, N);
+            copyArrayU16(array2, array3, N);
+        }
+        else if (saveCompareCounter >= highestCompares - 30) {
+            U64 mask = (1LLU << (highestCompares-saveCompareCounter+granularity)) - 1LLU;
+            if ((rand_pcg_u64() & mask) == 0) {
+                highestCompares = saveCompareCounter;
+                printf("compares = %lld\n", highestCompares);
+                copyArrayU16(array2, array3, N);
+            }
+            else {
+                copyArrayU16(array3, array2, N);
+            }
+        }
+        else {
+            copyArrayU16(array3, array2, N);
+        }
+        
+        U64 endTime = currentTime();
+        totalTime += endTime - startTime;
+    }
+    printArrayU16(array3, N);
+    
+    printf("numCompares = %lld, %g million compares\n", COMPARE_COUNTER, (COMPARE_COUNTER / 1000000.0));
+    printf("time to sort = %llu microseconds, %g seconds\n", totalTime, (totalTime / (double)TICKS_PER_SEC));
+    
+    printf("average compares per element = %g\n", ((COMPARE_COUNTER / (double)numSamples) / N));
+    
+    if (!isArraySortedU16(array, N)) {
+        printArrayU16(array, N);
+        printf("error 610\n");
+        exit(1);
+    }
+    
+    free(array3);
+    free(array2);
+    free(array);
+}
+
+// sample arrays hold the ranks 0..arraySize-1 in the narrowest type that fits: U8 up to 256, U16 up to 65536, int above
+// all three give identical compare counts for the same shuffle, the narrow ones just stream less memory per sample
+// array must have room for arraySize ints
+void initializeSampleArray(void* array, I64 arraySize) {
+    if (arraySize <= (1LL << 8)) {
+        initializeArrayU8(array, arraySize);
+    }
+    else if (arraySize <= (1LL << 16)) {
+        initializeArrayU16(array, arraySize);
+    }
+    else {
+        initializeArray(array, arraySize);
+    }
+}
+
+// kernel the sampling threads count compares with, so the searches find the best gaps for that kernel
+#define SAMPLE_KERNEL_LINEAR 0 // shellSortCustom, scans down each chain
+#define SAMPLE_KERNEL_BINARY 1 // shellSortCustomBinary, exponential then binary search down each chain, for expensive compares
+#define SAMPLE_KERNEL_INVERSIONS 2 // shellSortCustomInversions above 65536 elements, same counts as linear but badly disordered passes cost O(n log n)
+static int SAMPLE_KERNEL = SAMPLE_KERNEL_LINEAR;
+
+// persistent worker pool for the searches, created once per automated search and reused by every halving iteration and every gap
+// workers keep their sample arrays between rounds: sorting a sample leaves the ranks sorted again,
+// so an array is only reinitialized (or reallocated, first touched by its own worker) when the array size changes
+// each round workers claim candidates one at a time from a shared counter, so a thread that gets cheap candidates takes more
+typedef struct {
+    int* array;// sample array for the unbatched kernels, see initializeSampleArray
+    I64 arrayCapacity;// in ints
+    I64 arraySize;// size array currently holds sorted ranks for, 0 if none
+    int* kernelScratch;// 2*arraySize ints at the end of array for SAMPLE_KERNEL_INVERSIONS on int samples, NULL otherwise
+    int* soa;// SHELLSORT_BATCH_LANES interleaved int arrays for the batched kernels
+    I64 soaCapacity;// in ints
+    I64 soaSize;// size soa currently holds sorted ranks for in every lane, 0 if none
+    int node;// numa node the worker last ran on
+} __attribute__((aligned(64))) SearchWorker;
+
+typedef struct {
+    ShellSortPool* pool;
+    int numThreads;
+    SearchWorker* workers;
+    
+    // current round, set by searchSessionRun
+    void* (*run)(void*);
+    char* args;// one argument struct per worker
+    size_t argSize;
+    I64 numCandidates;
+    I64 nextCandidate;
+} SearchSession;
+
+SearchSession* searchSessionCreate(int numThreads) {
+    SearchSession* session = malloc(sizeof(SearchSession));
+    session->numThreads = numThreads;
+    session->pool = shellSortPoolCreate(numThreads);
+    session->workers = malloc(sizeof(SearchWorker) * numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        SearchWorker* worker = &session->workers[i];
+        worker->array = NULL;
+        worker->arrayCapacity = 0;
+        worker->arraySize = 0;
+        worker->kernelScratch = NULL;
+        worker->soa = NULL;
+        worker->soaCapacity = 0;
+        worker->soaSize = 0;
+        worker->node = -1;
+    }
+    return session;
+}
+
+void searchSessionDestroy(SearchSession* session) {
+    shellSortPoolDestroy(session->pool);
+    for (int i = 0; i < session->numThreads; i++) {
+        SearchWorker* worker = &session->workers[i];
+        if (worker->array != NULL) {
+            freeLargeBuffer(worker->array, sizeof(int) * worker->arrayCapacity);
+        }
+        if (worker->soa != NULL) {
+            freeLargeBuffer(worker->soa, sizeof(int) * worker->soaCapacity);
+        }
+    }
+    free(session->workers);
+    free(session);
+}
+
+// next candidate index for the calling worker, -1 when the round is done
+I64 searchSessionNextCandidate(SearchSession* session) {
+    I64 i = __atomic_fetch_add(&session->nextCandidate, 1, __ATOMIC_RELAXED);
+    return i < session->numCandidates ? i : -1;
+}
+
+static void searchSessionJob(void* context, I64 threadNum) {
+    SearchSession* session = context;
+    session->workers[threadNum].node = currentNumaNode();
+    session->run(session->args + threadNum * session->argSize);
+}
+
+// runs run(&args[i]) on worker i for every worker and waits for all of them, run claims candidates with searchSessionNextCandidate
+void searchSessionRun(SearchSession* session, void* (*run)(void*), void* args, size_t argSize, I64 numCandidates) {
+    session->run = run;
+    session->args = args;
+    session->argSize = argSize;
+    session->numCandidates = numCandidates;
+    session->nextCandidate = 0;
+    shellSortPoolRun(session->pool, searchSessionJob, session, session->numThreads);
+}
+
+// worker's sample array holding the sorted ranks for arraySize, call from the worker
+// with withScratch it is followed by room for arraySize more ints, scratch for the reversed shuffle under ANTITHETIC_SAMPLING
+// sets worker->kernelScratch for the sampling kernel, pass it to shuffleAndSortSample
+void* searchWorkerSampleArray(SearchWorker* worker, I64 arraySize, int withScratch) {
+    I64 capacity = withScratch ? 2 * arraySize : arraySize;
+    I64 kernelScratchSize = SAMPLE_KERNEL == SAMPLE_KERNEL_INVERSIONS && arraySize > (1LL << 16) ? 2 * arraySize : 0;
+    capacity += kernelScratchSize;
+    if (worker->arrayCapacity < capacity) {
+        if (worker->array != NULL) {
+            freeLargeBuffer(worker->array, sizeof(int) * worker->arrayCapacity);
         }
-        else if (saveCompareCounter >= highestCompares - 30) {
-            U64 mask = (1LLU << (highestCompares-saveCompareCounter+granularity)) - 1LLU;
-            if ((rand_pcg_u64() & mask) == 0) {
-                highestCompares = saveCompareCounter;
-                printf("compares = %lld\n", highestCompares);
-                copyArray(array2, array3, N);
-            }
-            else {
-                copyArray(array3, array2, N);
-            }
+        worker->array = allocateLargeBuffer(sizeof(int) * capacity);
+        worker->arrayCapacity = capacity;
+        worker->arraySize = 0;
+    }
+    if (worker->arraySize != arraySize) {
+        initializeSampleArray(worker->array, arraySize);
+        worker->arraySize = arraySize;
+    }
+    worker->kernelScratch = kernelScratchSize > 0 ? worker->array + capacity - kernelScratchSize : NULL;
+    return worker->array;
+}
+
+// worker's lane interleaved arrays with the sorted ranks for arraySize in every lane, call from the worker
+int* searchWorkerBatchArrays(SearchWorker* worker, I64 arraySize) {
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    if (worker->soaCapacity < arraySize * lanes) {
+        if (worker->soa != NULL) {
+            freeLargeBuffer(worker->soa, sizeof(int) * worker->soaCapacity);
         }
-        else {
-            copyArray(array3, array2, N);
+        worker->soa = allocateLargeBuffer(sizeof(int) * arraySize * lanes);
+        worker->soaCapacity = arraySize * lanes;
+        worker->soaSize = 0;
+    }
+    if (worker->soaSize != arraySize) {
+        for (I64 k = 0; k < arraySize; k++) {
+            for (I64 l = 0; l < lanes; l++) {
+                worker->soa[k * lanes + l] = (int)k;
+            }
         }
-        
-        U64 endTime = currentTime();
-        totalTime += endTime - startTime;
+        worker->soaSize = arraySize;
     }
-    printArray(array3, N);
-    
-    printf("numCompares = %lld, %g million compares\n", COMPARE_COUNTER, (COMPARE_COUNTER / 1000000.0));
-    printf("time to sort = %llu microseconds, %g seconds\n", totalTime, (totalTime / (double)TICKS_PER_SEC));
-    
-    printf("average compares per element = %g\n", ((COMPARE_COUNTER / (double)numSamples) / N));
-    
-    if (!isArraySorted(array, N)) {
-        printArray(array, N);
-        printf("error 610\n");
-        exit(1);
+    return worker->soa;
+}
+
+// when a round has fewer candidates than workers each candidate's samples are split into parts so every worker has work
+// every sample is seeded from its index with srand_pcg_sample, so all candidates still see the same shuffles and lookahead gaps
+// however they are split; parts get at least minPartSamples samples
+I64 searchPartsPerCandidate(int numThreads, I64 numCandidates, I64 numSamples, I64 minPartSamples) {
+    I64 numParts = (numThreads + numCandidates - 1) / numCandidates;
+    if (numParts > numSamples / minPartSamples) {
+        numParts = numSamples / minPartSamples;
     }
-    
-    free(array3);
-    free(array2);
-    free(array);
+    return numParts < 1 ? 1 : numParts;
+}
+
+// first sample of part in a round of numSamples samples split into numParts parts
+I64 searchPartStart(I64 numSamples, I64 numParts, I64 part) {
+    return part * numSamples / numParts;
+}
+
+// search engines narrow the candidates down to this many (or numThreads if fewer) before the final cut,
+// the workers split the samples of the finalists between them
+#define SEARCH_MIN_FINALISTS 3
+
+// after the first round of a search, where the workers' sample arrays ended up
+void printSearchWorkerPlacement(SearchSession* session, int batched) {
+    int numThreads = session->numThreads;
+    int* buffers[numThreads];
+    int nodes[numThreads];
+    I64 bytes = 0;
+    for (int i = 0; i < numThreads; i++) {
+        SearchWorker* worker = &session->workers[i];
+        buffers[i] = batched ? worker->soa : worker->array;
+        nodes[i] = worker->node;
+        bytes = sizeof(int) * (batched ? worker->soaSize * SHELLSORT_BATCH_LANES : worker->arraySize);
+    }
+    printWorkerBufferPlacement(buffers, nodes, numThreads, bytes);
 }
 
 typedef struct {
     GapAndCount* gapAndCountArray;
-    I64 startIndex;
-    I64 lastIndex;
+    SearchSession* session;
+    SearchWorker* worker;
     I64 arraySize;
     I64 numSamples;
     I64* gaps;
     I64 gapIndex1;
-    int* array;
+    I64 numParts;// parts each candidate's samples are split into, see searchPartsPerCandidate
+    SampleStats* partStats;// numParts entries per candidate, filled by the workers and merged by the engine
     
-    U64 pcgInitState;
+    U64 pcgInitState;// key and stream of the round for srand_pcg_sample
     U64 pcgInc;
 }
 ThreadArg;
 
+// pair every search sample's shuffle with its reverse and use the pair's average as the sample
+// reversing turns inversions into non-inversions, but the compare counts of the pair come out positively correlated
+// (about +0.2 to +0.35 with the search kernels), so the pairing increases the variance per sort and is off by default
+// the engines measure the change in variance per sort and report it, see printAntitheticReport
+static int ANTITHETIC_SAMPLING = 0;
+
+// shuffles a sample array set up by initializeSampleArray
+void shuffleSample(void* array, I64 arraySize) {
+    if (arraySize <= (1LL << 8)) {
+        shuffleArrayU8(array, arraySize);
+    }
+    else if (arraySize <= (1LL << 16)) {
+        shuffleArrayU16(array, arraySize);
+    }
+    else {
+        shuffleArray(array, arraySize);
+    }
+}
+
+// sorts a shuffled sample array with gaps, checks it and returns the compare count
+// kernelScratch is the worker's kernelScratch, see searchWorkerSampleArray
+I64 sortSample(void* array, I64 arraySize, I64 const gaps[], int kernelScratch[]) {
+    I64 compares;
+    int sorted;
+    int binary = SAMPLE_KERNEL == SAMPLE_KERNEL_BINARY;
+    if (arraySize <= (1LL << 8)) {
+        compares = binary ? shellSortCustomBinaryCountedU8(array, arraySize, gaps) : shellSortCustomCountedU8(array, arraySize, gaps);
+        sorted = isArraySortedU8(array, arraySize);
+    }
+    else if (arraySize <= (1LL << 16)) {
+        compares = binary ? shellSortCustomBinaryCountedU16(array, arraySize, gaps) : shellSortCustomCountedU16(array, arraySize, gaps);
+        sorted = isArraySortedU16(array, arraySize);
+    }
+    else {
+        if (SAMPLE_KERNEL == SAMPLE_KERNEL_INVERSIONS) {
+            compares = shellSortCustomInversions(array, arraySize, gaps, kernelScratch);
+        }
+        else {
+            compares = binary ? shellSortCustomBinaryCounted(array, arraySize, gaps) : shellSortCustomCounted(array, arraySize, gaps);
+        }
+        sorted = isArraySorted(array, arraySize);
+    }
+    if (!sorted) {
+        printf("error 1015\n");
+        exit(1);
+    }
+    return compares;
+}
+
+// shuffles a sample array set up by initializeSampleArray, sorts it with gaps, checks it and returns the compare count
+I64 shuffleAndSortSample(void* array, I64 arraySize, I64 const gaps[], int kernelScratch[]) {
+    shuffleSample(array, arraySize);
+    return sortSample(array, arraySize, gaps, kernelScratch);
+}
+
+// copies a sample array into reversed back to front
+void reverseCopySample(void const* array, void* reversed, I64 arraySize) {
+    if (arraySize <= (1LL << 8)) {
+        for (I64 i = 0; i < arraySize; i++) {
+            ((U8*)reversed)[i] = ((U8 const*)array)[arraySize-1-i];
+        }
+    }
+    else if (arraySize <= (1LL << 16)) {
+        for (I64 i = 0; i < arraySize; i++) {
+            ((U16*)reversed)[i] = ((U16 const*)array)[arraySize-1-i];
+        }
+    }
+    else {
+        for (I64 i = 0; i < arraySize; i++) {
+            ((int*)reversed)[i] = ((int const*)array)[arraySize-1-i];
+        }
+    }
+}
+
+// same as shuffleAndSortSample for ANTITHETIC_SAMPLING, also sorts the reverse of the shuffle in scratch (room for arraySize ints)
+// returns the compare count of the shuffle and puts the count of its reverse in reverseCompares
+I64 shuffleAndSortAntitheticPair(void* array, void* scratch, I64 arraySize, I64 const gaps[], int kernelScratch[], I64* reverseCompares) {
+    shuffleSample(array, arraySize);
+    reverseCopySample(array, scratch, arraySize);
+    *reverseCompares = sortSample(scratch, arraySize, gaps, kernelScratch);
+    return sortSample(array, arraySize, gaps, kernelScratch);
+}
+
+// with ANTITHETIC_SAMPLING, how the pairing changed the variance per sort compared to sorting independent shuffles,
+// the pair average has variance sortVariance * (1 + correlation) / 2 where two independent sorts would have sortVariance / 2
+void printAntitheticReport(const char* name, SampleStats const* stats) {
+    double pairVariance = sampleVariance(stats);
+    double sortVariance = stats->sortM2 / (2 * stats->sampleCount - 1);
+    double ratio = pairVariance / (sortVariance / 2);
+    if (ratio > 1) {
+        printf("  %s: %lld pairs, pair correlation %.4f, variance per sort increased %.2fx, reversal does not help\n", name, stats->sampleCount, ratio - 1, ratio);
+    }
+    else {
+        printf("  %s: %lld pairs, pair correlation %.4f, variance per sort reduced %.2fx\n", name, stats->sampleCount, ratio - 1, 1 / ratio);
+    }
+}
+
 void* thread_runSortingSamples(void* arg_) {
     ThreadArg* arg = arg_;
-    if (arg->lastIndex < 0 || arg->lastIndex < arg->startIndex) {
-        return NULL;
-    }
     // Reduced printing - only print on first thread
     //printf("thread search from indexes %lld to %lld\n", arg->startIndex, arg->lastIndex);
     //srand_pcg_easy(); // don't need this since we are seeding the pcg later with a specific seed
@@ -1011,16 +3065,19 @@ void* thread_runSortingSamples(void* arg_) {
     I64* gaps = arg->gaps;
     I64 gapIndex1 = arg->gapIndex1;
     
-    int* array = arg->array;
-    
-    initializeArray(array, arraySize);
+    void* array = searchWorkerSampleArray(arg->worker, arraySize, ANTITHETIC_SAMPLING);
     
-    for (I64 i = arg->startIndex; i <= arg->lastIndex; i++) {
+    for (I64 item = searchSessionNextCandidate(arg->session); item >= 0; item = searchSessionNextCandidate(arg->session)) {
+        I64 i = item / arg->numParts;
+        I64 part = item % arg->numParts;
         I64 gap1 = gapAndCountArray[i].gap;
+        SampleStats* stats = &arg->partStats[item];
+        memset(stats, 0, sizeof(SampleStats));
         
-        srand_pcg(arg->pcgInitState, arg->pcgInc);// use same seed for all gap1s so that shuffle is same and gap ratios are same
-        
-        for (int j = 0; j < arg->numSamples; j++) {
+        I64 lastSample = searchPartStart(arg->numSamples, arg->numParts, part + 1);
+        for (I64 j = searchPartStart(arg->numSamples, arg->numParts, part); j < lastSample; j++) {
+            srand_pcg_sample(arg->pcgInitState, arg->pcgInc, j);// same seed for sample j of all gap1s so that shuffle is same and gap ratios are same
+            
             // choose random gap2, gap3
             I64 gap2 = chooseRandomGap(gap1, 2.5, 2.9);// 2.4, 2.9 then 2.6, 3.3// 2.2, 2.8 then 2.3, 3.2 // 2.2, 4.9 both
             I64 gap3 = chooseRandomGap(gap2, 2.7, 3.3);// 2.5, 2.9 then 2.7, 3.3
@@ -1034,30 +3091,98 @@ void* thread_runSortingSamples(void* arg_) {
             gaps[gapIndex1+1] = gap2;
             gaps[gapIndex1+2] = gap3;
             
-            shuffleArray(array, arraySize);
-            
-            COMPARE_COUNTER = 0;
-            shellSortCustom(array, arraySize, gaps);
-            gapAndCountArray[i].count += COMPARE_COUNTER;
-            
-            // update using welford's online algorithm
-            gapAndCountArray[i].sampleCount += 1;
-            double delta = COMPARE_COUNTER - gapAndCountArray[i].mean;
-            gapAndCountArray[i].mean += delta / gapAndCountArray[i].sampleCount;
-            double delta2 = COMPARE_COUNTER - gapAndCountArray[i].mean;
-            gapAndCountArray[i].M2 += delta * delta2;
-            
-            if (!isArraySorted(array, arraySize)) {
-                printArray(array, arraySize);
-                printf("error 1015\n");
-                exit(1);
+            srand_pcg_sample(arg->pcgInitState, ~arg->pcgInc, j);// the shuffle has its own stream, independent of how many gaps were drawn
+            if (ANTITHETIC_SAMPLING) {
+                I64 reverseCompares;
+                I64 compares = shuffleAndSortAntitheticPair(array, (int*)array + arraySize, arraySize, gaps, arg->worker->kernelScratch, &reverseCompares);
+                addAntitheticPairStats(stats, compares, reverseCompares);
+            }
+            else {
+                addSampleStats(stats, shuffleAndSortSample(array, arraySize, gaps, arg->worker->kernelScratch));
             }
         }
         
         // Reduced printing - removed per-gap output
-        //printf("gap1=%lld, total compare count = %llu\n", gap1, gapAndCountArray[i].count);
+        //printf("gap1=%lld, total compare count = %llu\n", gap1, gapAndCountArray[i].stats.count);
+    }
+    
+    return NULL;
+}
+
+// same as thread_runSortingSamples but sorts SHELLSORT_BATCH_LANES samples at once with shellSortBatchCounted
+// seeds every sample from its index the same way, so it produces exactly the same counts and statistics
+// only for arraySize <= SHELLSORT_BATCH_MAX_LENGTH, worth it for small arrays where one sample is too short to vectorize well
+void* thread_runSortingSamplesBatched(void* arg_) {
+    ThreadArg* arg = arg_;
+    
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    GapAndCount* gapAndCountArray = arg->gapAndCountArray;
+    I64 arraySize = arg->arraySize;
+    I64 gapIndex1 = arg->gapIndex1;
+    I64 gapsSize = gapIndex1 + 4;
+    
+    int* soa = searchWorkerBatchArrays(arg->worker, arraySize);
+    
+    I64* laneGapsStorage = malloc(sizeof(I64) * gapsSize * lanes);
+    I64* laneGaps[SHELLSORT_BATCH_LANES];
+    for (I64 l = 0; l < lanes; l++) {
+        laneGaps[l] = &laneGapsStorage[l * gapsSize];
+        memcpy(laneGaps[l], arg->gaps, sizeof(I64) * gapIndex1);
+        laneGaps[l][gapIndex1+3] = -1;
+    }
+    
+    for (I64 item = searchSessionNextCandidate(arg->session); item >= 0; item = searchSessionNextCandidate(arg->session)) {
+        I64 i = item / arg->numParts;
+        I64 part = item % arg->numParts;
+        I64 gap1 = gapAndCountArray[i].gap;
+        SampleStats* stats = &arg->partStats[item];
+        memset(stats, 0, sizeof(SampleStats));
+        
+        I64 lastSample = searchPartStart(arg->numSamples, arg->numParts, part + 1);
+        for (I64 j = searchPartStart(arg->numSamples, arg->numParts, part); j < lastSample; j += lanes) {
+            I64 batchSize = lastSample - j < lanes ? lastSample - j : lanes;
+            for (I64 l = 0; l < lanes; l++) {
+                if (l >= batchSize) {
+                    // unused lane, sorts its already sorted array with the same gaps as lane 0
+                    laneGaps[l][gapIndex1] = laneGaps[0][gapIndex1];
+                    laneGaps[l][gapIndex1+1] = laneGaps[0][gapIndex1+1];
+                    laneGaps[l][gapIndex1+2] = laneGaps[0][gapIndex1+2];
+                    continue;
+                }
+                srand_pcg_sample(arg->pcgInitState, arg->pcgInc, j + l);// same seed for sample j + l of all gap1s
+                
+                // choose random gap2, gap3
+                I64 gap2 = chooseRandomGap(gap1, 2.5, 2.9);
+                I64 gap3 = chooseRandomGap(gap2, 2.7, 3.3);
+                
+                // avoid using exact multiple of previous gap
+                if (gap3 == 3 * gap2) {
+                    gap3 += 1;
+                }
+                
+                laneGaps[l][gapIndex1] = gap1;
+                laneGaps[l][gapIndex1+1] = gap2;
+                laneGaps[l][gapIndex1+2] = gap3;
+                
+                srand_pcg_sample(arg->pcgInitState, ~arg->pcgInc, j + l);// the shuffle has its own stream, independent of how many gaps were drawn
+                shuffleBatchLane(soa, arraySize, l);
+            }
+            
+            I64 compares[SHELLSORT_BATCH_LANES] = {0};
+            shellSortBatchCounted(soa, arraySize, (I64 const* const*)laneGaps, compares);
+            
+            for (I64 l = 0; l < batchSize; l++) {
+                addSampleStats(stats, compares[l]);
+                
+                if (!isBatchLaneSorted(soa, arraySize, l)) {
+                    printf("error 1232\n");
+                    exit(1);
+                }
+            }
+        }
     }
     
+    free(laneGapsStorage);
     return NULL;
 }
 
@@ -1066,50 +3191,55 @@ typedef struct {
     I64* fullSequence;        // Complete sequence including new gap
     int fromInitialIndex;     // Which initial sequence this came from
     I64 nextGap;             // The new gap being tested
-    I64 count;               // Total compare count
-    I64 sampleCount;
-    double mean;
-    double M2;
+    SampleStats stats;
 } SequenceCandidate;
 
 // Threading structures and functions for sequence candidate search
 typedef struct {
     SequenceCandidate* candidates;
-    I64 startIndex;
-    I64 lastIndex;
+    SearchSession* session;
+    SearchWorker* worker;
     I64 arraySize;
     I64 numSamples;
-    int* array;
+    I64 numParts;// parts each candidate's samples are split into, see searchPartsPerCandidate
+    SampleStats* partStats;// numParts entries per candidate, filled by the workers and merged by the engine
     
-    U64 pcgInitState;
+    U64 pcgInitState;// key and stream of the round for srand_pcg_sample
     U64 pcgInc;
 }
 SequenceThreadArg;
 
 void* thread_runSequenceSamples(void* arg_) {
     SequenceThreadArg* arg = arg_;
-    if (arg->lastIndex < 0 || arg->lastIndex < arg->startIndex) {
-        return NULL;
-    }
     
     SequenceCandidate* candidates = arg->candidates;
     I64 arraySize = arg->arraySize;
-    int* array = arg->array;
-    
-    initializeArray(array, arraySize);
+    void* array = searchWorkerSampleArray(arg->worker, arraySize, ANTITHETIC_SAMPLING);
+    I64* gaps = NULL;// this worker's copy of the candidate, other workers may be sampling the same one
+    I64 gapsSize = 0;
     
-    for (I64 i = arg->startIndex; i <= arg->lastIndex; i++) {
-        I64* gaps = candidates[i].fullSequence;
+    for (I64 item = searchSessionNextCandidate(arg->session); item >= 0; item = searchSessionNextCandidate(arg->session)) {
+        I64 i = item / arg->numParts;
+        I64 part = item % arg->numParts;
+        SampleStats* stats = &arg->partStats[item];
+        memset(stats, 0, sizeof(SampleStats));
         
         // Find where the sequence ends (before the 0, 0, 0, -1)
         I64 seqLen = 0;
-        while (gaps[seqLen] > 0) seqLen++;
+        while (candidates[i].fullSequence[seqLen] > 0) seqLen++;
         
-        I64 nextGap = gaps[seqLen - 1];  // The new gap we're testing
+        if (seqLen + 3 > gapsSize) {
+            gapsSize = seqLen + 3;
+            gaps = realloc(gaps, sizeof(I64) * gapsSize);
+        }
+        memcpy(gaps, candidates[i].fullSequence, sizeof(I64) * seqLen);
         
-        srand_pcg(arg->pcgInitState, arg->pcgInc);  // Same seed for consistent random gaps
+        I64 nextGap = gaps[seqLen - 1];  // The new gap we're testing
         
-        for (int j = 0; j < arg->numSamples; j++) {
+        I64 lastSample = searchPartStart(arg->numSamples, arg->numParts, part + 1);
+        for (I64 j = searchPartStart(arg->numSamples, arg->numParts, part); j < lastSample; j++) {
+            srand_pcg_sample(arg->pcgInitState, arg->pcgInc, j);  // Same seed for sample j of every candidate for consistent random gaps
+            
             // Generate random gap2, gap3 after nextGap
             I64 gap2 = chooseRandomGap(nextGap, 2.5, 2.9);
             I64 gap3 = chooseRandomGap(gap2, 2.7, 3.3);
@@ -1124,31 +3254,108 @@ void* thread_runSequenceSamples(void* arg_) {
             gaps[seqLen + 1] = gap3;
             gaps[seqLen + 2] = -1;
             
-            shuffleArray(array, arraySize);
-            
-            COMPARE_COUNTER = 0;
-            shellSortCustom(array, arraySize, gaps);
-            candidates[i].count += COMPARE_COUNTER;
+            srand_pcg_sample(arg->pcgInitState, ~arg->pcgInc, j);// the shuffle has its own stream, independent of how many gaps were drawn
+            if (ANTITHETIC_SAMPLING) {
+                I64 reverseCompares;
+                I64 compares = shuffleAndSortAntitheticPair(array, (int*)array + arraySize, arraySize, gaps, arg->worker->kernelScratch, &reverseCompares);
+                addAntitheticPairStats(stats, compares, reverseCompares);
+            }
+            else {
+                addSampleStats(stats, shuffleAndSortSample(array, arraySize, gaps, arg->worker->kernelScratch));
+            }
+        }
+    }
+    
+    free(gaps);
+    return NULL;
+}
+
+// same as thread_runSequenceSamples but sorts SHELLSORT_BATCH_LANES samples at once with shellSortBatchCounted
+// seeds every sample from its index the same way, so it produces exactly the same counts and statistics
+// only for arraySize <= SHELLSORT_BATCH_MAX_LENGTH
+void* thread_runSequenceSamplesBatched(void* arg_) {
+    SequenceThreadArg* arg = arg_;
+    
+    const I64 lanes = SHELLSORT_BATCH_LANES;
+    SequenceCandidate* candidates = arg->candidates;
+    I64 arraySize = arg->arraySize;
+    
+    int* soa = searchWorkerBatchArrays(arg->worker, arraySize);
+    
+    I64* laneGaps[SHELLSORT_BATCH_LANES];
+    for (I64 l = 0; l < lanes; l++) {
+        laneGaps[l] = NULL;
+    }
+    I64 laneGapsSize = 0;
+    
+    for (I64 item = searchSessionNextCandidate(arg->session); item >= 0; item = searchSessionNextCandidate(arg->session)) {
+        I64 i = item / arg->numParts;
+        I64 part = item % arg->numParts;
+        I64* gaps = candidates[i].fullSequence;
+        SampleStats* stats = &arg->partStats[item];
+        memset(stats, 0, sizeof(SampleStats));
+        
+        // Find where the sequence ends (before the 0, 0, 0, -1)
+        I64 seqLen = 0;
+        while (gaps[seqLen] > 0) seqLen++;
+        
+        if (seqLen + 3 > laneGapsSize) {
+            laneGapsSize = seqLen + 3;
+            for (I64 l = 0; l < lanes; l++) {
+                laneGaps[l] = realloc(laneGaps[l], sizeof(I64) * laneGapsSize);
+            }
+        }
+        for (I64 l = 0; l < lanes; l++) {
+            memcpy(laneGaps[l], gaps, sizeof(I64) * seqLen);
+        }
+        
+        I64 nextGap = gaps[seqLen - 1];  // The new gap we're testing
+        
+        I64 lastSample = searchPartStart(arg->numSamples, arg->numParts, part + 1);
+        for (I64 j = searchPartStart(arg->numSamples, arg->numParts, part); j < lastSample; j += lanes) {
+            I64 batchSize = lastSample - j < lanes ? lastSample - j : lanes;
+            for (I64 l = 0; l < lanes; l++) {
+                if (l >= batchSize) {
+                    // unused lane, sorts its already sorted array with the same gaps as lane 0
+                    memcpy(laneGaps[l], laneGaps[0], sizeof(I64) * (seqLen + 3));
+                    continue;
+                }
+                srand_pcg_sample(arg->pcgInitState, arg->pcgInc, j + l);  // Same seed for sample j + l of every candidate
+                
+                // Generate random gap2, gap3 after nextGap
+                I64 gap2 = chooseRandomGap(nextGap, 2.5, 2.9);
+                I64 gap3 = chooseRandomGap(gap2, 2.7, 3.3);
+                
+                // Avoid exact multiples
+                if (gap3 == 3 * gap2) {
+                    gap3 += 1;
+                }
+                
+                laneGaps[l][seqLen] = gap2;
+                laneGaps[l][seqLen + 1] = gap3;
+                laneGaps[l][seqLen + 2] = -1;
+                
+                srand_pcg_sample(arg->pcgInitState, ~arg->pcgInc, j + l);// the shuffle has its own stream, independent of how many gaps were drawn
+                shuffleBatchLane(soa, arraySize, l);
+            }
             
-            // Update using Welford's online algorithm
-            candidates[i].sampleCount += 1;
-            double delta = COMPARE_COUNTER - candidates[i].mean;
-            candidates[i].mean += delta / candidates[i].sampleCount;
-            double delta2 = COMPARE_COUNTER - candidates[i].mean;
-            candidates[i].M2 += delta * delta2;
+            I64 compares[SHELLSORT_BATCH_LANES] = {0};
+            shellSortBatchCounted(soa, arraySize, (I64 const* const*)laneGaps, compares);
             
-            if (!isArraySorted(array, arraySize)) {
-                printf("error in thread_runSequenceSamples\n");
-                exit(1);
+            for (I64 l = 0; l < batchSize; l++) {
+                addSampleStats(stats, compares[l]);
+                
+                if (!isBatchLaneSorted(soa, arraySize, l)) {
+                    printf("error in thread_runSequenceSamplesBatched\n");
+                    exit(1);
+                }
             }
         }
-        
-        // Restore original terminator
-        gaps[seqLen] = 0;
-        gaps[seqLen + 1] = 0;
-        gaps[seqLen + 2] = -1;
     }
     
+    for (I64 l = 0; l < lanes; l++) {
+        free(laneGaps[l]);
+    }
     return NULL;
 }
 
@@ -1166,14 +3373,27 @@ I64 findOptimalNextGap_parameterized(
     double maxRuntimeSeconds,
     int numThreads,
     I64* numRemainingGaps,        // output: how many gaps remained at end
-    double* minStdErrsUsed        // output: minimum stdErrs used for cutting
+    double* minStdErrsUsed,       // output: minimum stdErrs used for cutting
+    SearchSession* session        // worker pool with numThreads workers, or NULL to use a pool just for this search
 ) {
     U64 startTime = currentTime();
+    SearchSession* ownSession = NULL;
+    if (session == NULL) {
+        session = ownSession = searchSessionCreate(numThreads);
+    }
+    if (session->numThreads != numThreads) {
+        printf("error 3523\n");
+        exit(1);
+    }
     int numSamples = initialNumSamples;
     
     I64 arraySize = round(gaps[gapIndex1-1] / 301.0 * 8000.0);
     printf("arraySize = %lld\n", arraySize);
     
+    // sort SHELLSORT_BATCH_LANES samples at once in SIMD lanes for small arrays, gives identical statistics
+    // the batched kernel only does linear chains
+    int useBatchedSampling = arraySize <= SHELLSORT_BATCH_SAMPLING_MAX_LENGTH && detectSimdLevel() >= 1 && SAMPLE_KERNEL == SAMPLE_KERNEL_LINEAR && !ANTITHETIC_SAMPLING;
+    
     I64 gap0 = gaps[gapIndex1-1];
     I64 minGap1 = minRatio * gap0;
     I64 maxGap1 = maxRatio * gap0;
@@ -1274,17 +3494,14 @@ I64 findOptimalNextGap_parameterized(
     GapAndCount* gapAndCountArray = malloc(sizeof(GapAndCount) * numGap1s);
     for (int i = 0; i < numGap1s; i++) {
         gapAndCountArray[i].gap = gap1s[i];
-        gapAndCountArray[i].count = 0;
-        gapAndCountArray[i].mean = 0;
-        gapAndCountArray[i].M2 = 0;
-        gapAndCountArray[i].sampleCount = 0;
+        memset(&gapAndCountArray[i].stats, 0, sizeof(SampleStats));
     }
     
     
-    int* array_for_thread[numThreads];
     I64* gaps_for_thread[numThreads];
-    pthread_t threads[numThreads];
     ThreadArg threadArgs[numThreads];
+    SampleStats* partStats = malloc(sizeof(SampleStats) * (numGap1s + 2 * numThreads));// ceil(numThreads / n) * n parts is less than n + numThreads
+    int finalists = numThreads < SEARCH_MIN_FINALISTS ? numThreads : SEARCH_MIN_FINALISTS;
     
     // Calculate size of gaps array (count until we hit -1)
     I64 gapsSize = 0;
@@ -1294,7 +3511,6 @@ I64 findOptimalNextGap_parameterized(
     gapsSize++; // include the -1
     
     for (int i = 0; i < numThreads; i++) {
-        array_for_thread[i] = malloc(sizeof(int) * arraySize);
         gaps_for_thread[i] = malloc(sizeof(I64) * gapsSize);
         memcpy(gaps_for_thread[i], gaps, sizeof(I64) * gapsSize);
     }
@@ -1310,31 +3526,28 @@ I64 findOptimalNextGap_parameterized(
     while (numGap1s > 1) {
         U64 pcgInitState = rand_pcg_u64();
         U64 pcgInc = rand_pcg_u64();
+        I64 numParts = searchPartsPerCandidate(numThreads, numGap1s, numSamples, useBatchedSampling ? SHELLSORT_BATCH_LANES : 1);
         for (int i = 0; i < numThreads; i++) {
             threadArgs[i].gapAndCountArray = gapAndCountArray;
-            if (i == 0) {
-                threadArgs[i].startIndex = 0;
-            }
-            else {
-                threadArgs[i].startIndex = threadArgs[i-1].lastIndex + 1;
-            }
-            if (i == numThreads - 1) {
-                threadArgs[i].lastIndex = numGap1s - 1;
-            }
-            else {
-                threadArgs[i].lastIndex = ((i+1) * numGap1s) / numThreads - 1;
-            }
+            threadArgs[i].session = session;
+            threadArgs[i].worker = &session->workers[i];
             threadArgs[i].arraySize = arraySize;
             threadArgs[i].numSamples = numSamples;
             threadArgs[i].gaps = gaps_for_thread[i];
             threadArgs[i].gapIndex1 = gapIndex1;
-            threadArgs[i].array = array_for_thread[i];
+            threadArgs[i].numParts = numParts;
+            threadArgs[i].partStats = partStats;
             threadArgs[i].pcgInitState = pcgInitState;
             threadArgs[i].pcgInc = pcgInc;
-            pthread_create(&threads[i], NULL, thread_runSortingSamples, (void*)&threadArgs[i]);
         }
-        for (int i = 0; i < numThreads; i++) {
-            pthread_join(threads[i], NULL);
+        searchSessionRun(session, useBatchedSampling ? thread_runSortingSamplesBatched : thread_runSortingSamples, threadArgs, sizeof(ThreadArg), numGap1s * numParts);
+        for (I64 i = 0; i < numGap1s; i++) {
+            for (I64 part = 0; part < numParts; part++) {
+                mergeSampleStats(&gapAndCountArray[i].stats, &partStats[i * numParts + part]);
+            }
+        }
+        if (NUMA_REPORT && iterationCount == 0) {
+            printSearchWorkerPlacement(session, useBatchedSampling);
         }
         if (COMPARE_COUNTER != 0) {
             printf("error 1577\n");
@@ -1353,20 +3566,20 @@ I64 findOptimalNextGap_parameterized(
         I64 targetNumGaps = (I64)(initialNumGap1s / pow(2.0, targetHalvingsDone));
         if (targetNumGaps < 1) targetNumGaps = 1;
         
-        // Don't cut below numThreads during search - keep parallel resources fully utilized
+        // Don't cut below the finalists during search, the workers split their samples so all cores stay busy
         // Exception: if we naturally converge to 1, that's fine to end early
-        if (targetNumGaps < numThreads && targetNumGaps > 1) {
-            targetNumGaps = numThreads;
+        if (targetNumGaps < finalists && targetNumGaps > 1) {
+            targetNumGaps = finalists;
         }
         
         // Calculate statistics
         double pooled_variance = 0;
         for (I64 i = 0; i < numGap1s; i++) {
-            double sample_variance = gapAndCountArray[i].M2 / (gapAndCountArray[i].sampleCount - 1);
+            double sample_variance = sampleVariance(&gapAndCountArray[i].stats);
             pooled_variance += sample_variance;
         }
         pooled_variance /= numGap1s;
-        double pooledStdErr = sqrt(pooled_variance / gapAndCountArray[0].sampleCount);
+        double pooledStdErr = sqrt(pooled_variance / gapAndCountArray[0].stats.sampleCount);
         
         // Direct calculation of stdErrs needed to cut to targetNumGaps
         // Much simpler: just look at the gap at index targetNumGaps and calculate its distance from best
@@ -1376,9 +3589,9 @@ I64 findOptimalNextGap_parameterized(
         if (targetIndex < 0) targetIndex = 0;
         if (targetIndex >= numGap1s) targetIndex = numGap1s - 1;
         
-        // Enforce minimum of numThreads for parallel efficiency
-        if (targetIndex < numThreads - 1 && targetIndex > 0 && numGap1s > numThreads) {
-            targetIndex = numThreads - 1;  // Keep at least numThreads gaps
+        // Keep the finalists until the final cut
+        if (targetIndex < finalists - 1 && targetIndex > 0 && numGap1s > finalists) {
+            targetIndex = finalists - 1;  // Keep at least finalists gaps
         }
         
         I64 newNumGap1s = targetIndex + 1;  // Keep gaps from index 0 to targetIndex (inclusive)
@@ -1388,7 +3601,7 @@ I64 findOptimalNextGap_parameterized(
         double adaptiveNumStdErrs;
         if (newNumGap1s < numGap1s) {
             // We're cutting - show distance to first gap being cut (at index newNumGap1s)
-            double meanDifference = gapAndCountArray[newNumGap1s].mean - gapAndCountArray[0].mean;
+            double meanDifference = gapAndCountArray[newNumGap1s].stats.mean - gapAndCountArray[0].stats.mean;
             adaptiveNumStdErrs = meanDifference / pooledStdErr;
         } else {
             // No cut this iteration - use default large value to indicate no cut
@@ -1403,22 +3616,22 @@ I64 findOptimalNextGap_parameterized(
         
         // Apply the cut - even if newNumGap1s == numGap1s (no cut), that's fine!
         // This allows iterations where we don't cut, just gather more samples
-        // Don't cut below numThreads unless converging to 1 (natural end)
+        // Don't cut below the finalists unless converging to 1 (natural end)
         if (newNumGap1s <= numGap1s && newNumGap1s >= 1) {
-            if (newNumGap1s >= numThreads || newNumGap1s == 1) {
+            if (newNumGap1s >= finalists || newNumGap1s == 1) {
                 numGap1s = newNumGap1s;
                 if (adaptiveNumStdErrs < minStdErrs) {
                     minStdErrs = adaptiveNumStdErrs;
                 }
             }
-            // else: skip this cut because it would go below numThreads
+            // else: skip this cut because it would go below the finalists
         }
         
-        // Force cut to numThreads if we're stuck above it and target says we should be there
+        // Force cut to the finalists if we're stuck above it and target says we should be there
         // This handles cases where statistical thresholds can't distinguish well enough
-        if (numGap1s > numThreads && targetNumGaps <= numThreads && targetNumGaps > 1) {
-            // Just take the top numThreads gaps directly
-            numGap1s = numThreads;
+        if (numGap1s > finalists && targetNumGaps <= finalists && targetNumGaps > 1) {
+            // Just take the top finalists gaps directly
+            numGap1s = finalists;
             if (adaptiveNumStdErrs < minStdErrs) {
                 minStdErrs = adaptiveNumStdErrs;
             }
@@ -1429,12 +3642,12 @@ I64 findOptimalNextGap_parameterized(
         // Print summary every few iterations or when gaps is small
         if (iterationCount % 5 == 0 || numGap1s <= 10) {
             const char* status = "";
-            if (numGap1s == numThreads && targetNumGaps < numThreads) {
-                status = " [holding at numThreads]";
+            if (numGap1s == finalists && targetNumGaps < finalists) {
+                status = " [holding at finalists]";
             }
             printf("Iter %d: time %.1fs (%.0f%%), %lld gaps remain (target %lld), stdErrs=%.2f, samples=%d, best gap=%lld%s\n",
                    iterationCount, elapsedTime, timePercent * 100, numGap1s, targetNumGaps, 
-                   adaptiveNumStdErrs, (int)gapAndCountArray[0].sampleCount, gapAndCountArray[0].gap, status);
+                   adaptiveNumStdErrs, (int)gapAndCountArray[0].stats.sampleCount, gapAndCountArray[0].gap, status);
         }
         
         if (elapsedTime > maxRuntimeSeconds) {
@@ -1449,12 +3662,20 @@ I64 findOptimalNextGap_parameterized(
     printf("\n=== Search Complete ===\n");
     printf("Remaining gaps: %lld\n", numGap1s);
     printf("Minimum stdErrs used for cutting: %.2f\n", minStdErrs);
-    printf("Total samples per gap: %lld\n", gapAndCountArray[0].sampleCount);
+    printf("Total samples per gap: %lld\n", gapAndCountArray[0].stats.sampleCount);
     printf("Top candidate gap(s):\n");
     
     I64 numToShow = numGap1s < 5 ? numGap1s : 5;
     for (I64 i = 0; i < numToShow; i++) {
-        printf("  #%lld: gap=%lld, mean=%.1f\n", i+1, gapAndCountArray[i].gap, gapAndCountArray[i].mean);
+        printf("  #%lld: gap=%lld, mean=%.1f\n", i+1, gapAndCountArray[i].gap, gapAndCountArray[i].stats.mean);
+    }
+    if (ANTITHETIC_SAMPLING) {
+        printf("Antithetic sampling:\n");
+        for (I64 i = 0; i < numToShow; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "gap=%lld", gapAndCountArray[i].gap);
+            printAntitheticReport(name, &gapAndCountArray[i].stats);
+        }
     }
     
     I64 bestGap = gapAndCountArray[0].gap;
@@ -1467,7 +3688,10 @@ I64 findOptimalNextGap_parameterized(
     
     for (int i = 0; i < numThreads; i++) {
         free(gaps_for_thread[i]);
-        free(array_for_thread[i]);
+    }
+    free(partStats);
+    if (ownSession != NULL) {
+        searchSessionDestroy(ownSession);
     }
     free(gapAndCountArray);
     free(gap1s);
@@ -1552,6 +3776,9 @@ void findMultipleGapsAutomated(
     gaps[numInitialGaps + 2] = 0;
     gaps[numInitialGaps + 3] = -1;
     
+    // one pool of workers for every gap, so threads and their sample arrays are set up once
+    SearchSession* session = searchSessionCreate(numThreads);
+    
     // Find each gap in sequence
     for (int gapIdx = 0; gapIdx < numGapsToFind; gapIdx++) {
         int currentGapIndex = numInitialGaps + gapIdx;
@@ -1584,7 +3811,8 @@ void findMultipleGapsAutomated(
             maxRuntimePerGapSeconds,
             numThreads,
             &numRemainingGaps,
-            &minStdErrsUsed
+            &minStdErrsUsed,
+            session
         );
         U64 gapSearchEnd = currentTime();
         double gapSearchTime = (gapSearchEnd - gapSearchStart) / (double)TICKS_PER_SEC;
@@ -1652,6 +3880,7 @@ void findMultipleGapsAutomated(
         fclose(logFile);
     }
     
+    searchSessionDestroy(session);
     free(gaps);
 }
 
@@ -1659,8 +3888,8 @@ void findMultipleGapsAutomated(
 int compareSequenceCandidate(const void* a, const void* b) {
     const SequenceCandidate* sa = (const SequenceCandidate*)a;
     const SequenceCandidate* sb = (const SequenceCandidate*)b;
-    if (sa->count < sb->count) return -1;
-    if (sa->count > sb->count) return 1;
+    if (sa->stats.count < sb->stats.count) return -1;
+    if (sa->stats.count > sb->stats.count) return 1;
     return 0;
 }
 
@@ -1676,8 +3905,17 @@ void findMultipleBestSequences(
     double maxRatio,
     double maxRuntimeSeconds,
     int numThreads,
-    I64** outputSequences         // Output: best sequences (caller allocates)
+    I64** outputSequences,        // Output: best sequences (caller allocates)
+    SearchSession* session        // worker pool with numThreads workers, or NULL to use a pool just for this search
 ) {
+    SearchSession* ownSession = NULL;
+    if (session == NULL) {
+        session = ownSession = searchSessionCreate(numThreads);
+    }
+    if (session->numThreads != numThreads) {
+        printf("error 4038\n");
+        exit(1);
+    }
     printf("\n=== Searching for best %d sequences from %d initial sequences ===\n", 
            numBestToKeep, numInitialSequences);
     
@@ -1691,6 +3929,9 @@ void findMultipleBestSequences(
     
     printf("Average last gap: %lld, arraySize: %lld\n", avgLastGap, arraySize);
     
+    // sort SHELLSORT_BATCH_LANES samples at once in SIMD lanes for small arrays, gives identical statistics
+    int useBatchedSampling = arraySize <= SHELLSORT_BATCH_SAMPLING_MAX_LENGTH && detectSimdLevel() >= 1 && SAMPLE_KERNEL == SAMPLE_KERNEL_LINEAR && !ANTITHETIC_SAMPLING;
+    
     // Count total candidates
     I64 totalCandidates = 0;
     for (int i = 0; i < numInitialSequences; i++) {
@@ -1726,10 +3967,7 @@ void findMultipleBestSequences(
             
             candidates[candidateIdx].fromInitialIndex = i;
             candidates[candidateIdx].nextGap = nextGap;
-            candidates[candidateIdx].count = 0;
-            candidates[candidateIdx].sampleCount = 0;
-            candidates[candidateIdx].mean = 0;
-            candidates[candidateIdx].M2 = 0;
+            memset(&candidates[candidateIdx].stats, 0, sizeof(SampleStats));
             
             candidateIdx++;
         }
@@ -1743,13 +3981,9 @@ void findMultipleBestSequences(
     I64 numRemaining = totalCandidates;
     
     // Prepare threading
-    int* array_for_thread[numThreads];
-    pthread_t threads[numThreads];
     SequenceThreadArg threadArgs[numThreads];
-    
-    for (int i = 0; i < numThreads; i++) {
-        array_for_thread[i] = malloc(sizeof(int) * arraySize);
-    }
+    SampleStats* partStats = malloc(sizeof(SampleStats) * (totalCandidates + 2 * numThreads));// ceil(numThreads / n) * n parts is less than n + numThreads
+    int finalists = numThreads < SEARCH_MIN_FINALISTS ? numThreads : SEARCH_MIN_FINALISTS;
     
     double targetHalvings = log(totalCandidates / (double)numBestToKeep) / log(2.0);
     double minStdErrs = 999.0;
@@ -1762,31 +3996,28 @@ void findMultipleBestSequences(
         // Run samples on all remaining candidates using threads
         U64 pcgInitState = rand_pcg_u64();
         U64 pcgInc = rand_pcg_u64();
+        I64 numParts = searchPartsPerCandidate(numThreads, numRemaining, numSamples, useBatchedSampling ? SHELLSORT_BATCH_LANES : 1);
         
         for (int i = 0; i < numThreads; i++) {
             threadArgs[i].candidates = candidates;
-            if (i == 0) {
-                threadArgs[i].startIndex = 0;
-            }
-            else {
-                threadArgs[i].startIndex = threadArgs[i-1].lastIndex + 1;
-            }
-            if (i == numThreads - 1) {
-                threadArgs[i].lastIndex = numRemaining - 1;
-            }
-            else {
-                threadArgs[i].lastIndex = ((i+1) * numRemaining) / numThreads - 1;
-            }
+            threadArgs[i].session = session;
+            threadArgs[i].worker = &session->workers[i];
             threadArgs[i].arraySize = arraySize;
             threadArgs[i].numSamples = numSamples;
-            threadArgs[i].array = array_for_thread[i];
+            threadArgs[i].numParts = numParts;
+            threadArgs[i].partStats = partStats;
             threadArgs[i].pcgInitState = pcgInitState;
             threadArgs[i].pcgInc = pcgInc;
-            pthread_create(&threads[i], NULL, thread_runSequenceSamples, (void*)&threadArgs[i]);
+        }
+        searchSessionRun(session, useBatchedSampling ? thread_runSequenceSamplesBatched : thread_runSequenceSamples, threadArgs, sizeof(SequenceThreadArg), numRemaining * numParts);
+        for (I64 i = 0; i < numRemaining; i++) {
+            for (I64 part = 0; part < numParts; part++) {
+                mergeSampleStats(&candidates[i].stats, &partStats[i * numParts + part]);
+            }
         }
         
-        for (int i = 0; i < numThreads; i++) {
-            pthread_join(threads[i], NULL);
+        if (NUMA_REPORT && iterationCount == 0) {
+            printSearchWorkerPlacement(session, useBatchedSampling);
         }
         
         if (COMPARE_COUNTER != 0) {
@@ -1806,9 +4037,9 @@ void findMultipleBestSequences(
         I64 targetNum = (I64)(totalCandidates / pow(2.0, targetHalvingsDone));
         if (targetNum < numBestToKeep) targetNum = numBestToKeep;
         
-        // Enforce minimum of numThreads for parallel efficiency
-        if (targetNum < numThreads && targetNum > numBestToKeep) {
-            targetNum = numThreads;
+        // Keep the finalists until the final cut, the workers split their samples so all cores stay busy
+        if (targetNum < finalists && targetNum > numBestToKeep) {
+            targetNum = finalists;
         }
         
         // Calculate stdErrs and cut
@@ -1821,21 +4052,21 @@ void findMultipleBestSequences(
         // Calculate stdErrs
         double pooled_variance = 0;
         for (I64 i = 0; i < numRemaining; i++) {
-            double sample_variance = candidates[i].M2 / (candidates[i].sampleCount - 1);
+            double sample_variance = sampleVariance(&candidates[i].stats);
             pooled_variance += sample_variance;
         }
         pooled_variance /= numRemaining;
-        double pooledStdErr = sqrt(pooled_variance / candidates[0].sampleCount);
+        double pooledStdErr = sqrt(pooled_variance / candidates[0].stats.sampleCount);
         
         double adaptiveNumStdErrs = 10.0;
         if (newNumRemaining < numRemaining) {
-            double meanDiff = candidates[newNumRemaining].mean - candidates[0].mean;
+            double meanDiff = candidates[newNumRemaining].stats.mean - candidates[0].stats.mean;
             adaptiveNumStdErrs = meanDiff / pooledStdErr;
             if (adaptiveNumStdErrs < 0.0) adaptiveNumStdErrs = 0.0;
         }
         
         if (newNumRemaining <= numRemaining && newNumRemaining >= numBestToKeep) {
-            if (newNumRemaining >= numThreads || newNumRemaining == numBestToKeep) {
+            if (newNumRemaining >= finalists || newNumRemaining == numBestToKeep) {
                 numRemaining = newNumRemaining;
                 if (adaptiveNumStdErrs < minStdErrs) {
                     minStdErrs = adaptiveNumStdErrs;
@@ -1844,8 +4075,8 @@ void findMultipleBestSequences(
         }
         
         // Force cut if stuck
-        if (numRemaining > numThreads && targetNum <= numThreads && targetNum > numBestToKeep) {
-            numRemaining = numThreads;
+        if (numRemaining > finalists && targetNum <= finalists && targetNum > numBestToKeep) {
+            numRemaining = finalists;
         }
         
         iterationCount++;
@@ -1853,7 +4084,7 @@ void findMultipleBestSequences(
         if (iterationCount % 5 == 0 || numRemaining <= 10) {
             printf("Iter %d: time %.1fs (%.0f%%), %lld sequences remain (target %lld), stdErrs=%.2f, samples=%lld\n",
                    iterationCount, elapsedTime, timePercent * 100, numRemaining, targetNum,
-                   adaptiveNumStdErrs, candidates[0].sampleCount);
+                   adaptiveNumStdErrs, candidates[0].stats.sampleCount);
         }
         
         if (elapsedTime > maxRuntimeSeconds) {
@@ -1874,7 +4105,15 @@ void findMultipleBestSequences(
             outputSequences[i][j] = candidates[i].fullSequence[j];
         }
         printf("  #%lld: from initial[%d], next gap=%lld, mean=%.1f\n",
-               i+1, candidates[i].fromInitialIndex, candidates[i].nextGap, candidates[i].mean);
+               i+1, candidates[i].fromInitialIndex, candidates[i].nextGap, candidates[i].stats.mean);
+    }
+    if (ANTITHETIC_SAMPLING) {
+        printf("Antithetic sampling:\n");
+        for (I64 i = 0; i < numToCopy; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "next gap=%lld", candidates[i].nextGap);
+            printAntitheticReport(name, &candidates[i].stats);
+        }
     }
     
     // Cleanup
@@ -1882,8 +4121,9 @@ void findMultipleBestSequences(
         free(candidates[i].fullSequence);
     }
     free(candidates);
-    for (int i = 0; i < numThreads; i++) {
-        free(array_for_thread[i]);
+    free(partStats);
+    if (ownSession != NULL) {
+        searchSessionDestroy(ownSession);
     }
 }
 
@@ -1955,6 +4195,9 @@ void findBestSequenceAutomatedMultiBranch(
     }
     int currentCount = numInitialSequences;
     
+    // one pool of workers for every iteration, so threads and their sample arrays are set up once
+    SearchSession* session = searchSessionCreate(numThreads);
+    
     // Run iterations
     for (int iter = 0; iter <= numIterations; iter++) {
         int targetCount = numToKeep[iter];
@@ -1991,7 +4234,8 @@ void findBestSequenceAutomatedMultiBranch(
         findMultipleBestSequences(
             currentSequences, currentCount, currentLength, targetCount,
             minRatio, maxRatio, iterTimeAllocation, numThreads,
-            nextSequences
+            nextSequences,
+            session
         );
         
         U64 iterEnd = currentTime();
@@ -2069,6 +4313,7 @@ void findBestSequenceAutomatedMultiBranch(
     free(currentSequences);
     free(nextSequences);
     free(numToKeep);
+    searchSessionDestroy(session);
     
     if (logFile) {
         fclose(logFile);
@@ -2093,6 +4338,66 @@ int main(int argc, const char * argv[]) {
         testAverageRuntime();
     }
     
+    // compare scalar and vectorized kernels
+    if (0) {
+        testSimdRuntime();
+    }
+    
+    // compare gap tables for different element sizes
+    if (0) {
+        testTypedRuntime();
+    }
+    
+    // compare kernels with baked in gaps
+    if (0) {
+        testFixedRuntime();
+    }
+    
+    // compare fixed length kernels on small buffers
+    if (0) {
+        testFixedLengthRuntime();
+    }
+    
+    // compare the data oblivious pratt kernel with insertion based shell sort
+    if (0) {
+        testPrattRuntime();
+    }
+    
+    // leaderboard of every registered gap sequence
+    if (0) {
+        testGapSequenceBakeOff();
+    }
+    
+    // compare shellsort_r and qsort
+    if (0) {
+        testShellsortRRuntime();
+    }
+    
+    // compare the header only library against one global sequence
+    if (0) {
+        testShellsortLibrary();
+    }
+    
+    // compare adaptive pass skipping on random and presorted inputs
+    if (0) {
+        testAdaptiveCompares();
+    }
+    
+    // compare the cache blocked engine on large arrays
+    if (0) {
+        testBlockedRuntime();
+    }
+    
+    // compare the multithreaded kernel against the single threaded one
+    if (0) {
+        testMultithreadedRuntime();
+    }
+    
+    // compare first touch and interleaved placement of the shared array
+    if (0) {
+        testNumaPlacement();
+    }
+    
     // find worst case approximation using a greedy algorithm
     if (0) {
         findWorstCase(512, gaps_dokken12_222f);
@@ -2103,6 +4408,23 @@ int main(int argc, const char * argv[]) {
         findWorstCaseWithRandomMutations();
     }
     
+    // optimize gaps for binary insertion chains instead of linear ones, applies to all the searches below
+    if (0) {
+        SAMPLE_KERNEL = SAMPLE_KERNEL_BINARY;
+    }
+    
+    // count the search samples with the inversion evaluator, same counts, faster when wide gap ratios leave passes badly disordered
+    if (0) {
+        SAMPLE_KERNEL = SAMPLE_KERNEL_INVERSIONS;
+    }
+    
+    // numa placement for the searches: pin workers spread over the nodes, 2 MB pages for the sample arrays, report where buffers landed
+    if (0) {
+        PIN_THREADS = PIN_THREADS_SPREAD;
+        USE_HUGE_PAGES = 1;
+        NUMA_REPORT = 1;
+    }
+    
     // automated search for multiple gaps in sequence (single branch)
     if (0) {
         I64 startingGaps[] = {1, 4, 10, 23, 57, 132, 301, 701};
@@ -0,0 +1,228 @@
+//
+//  shellsort.h
+//  ShellSort
+//
+//  Header only shell sort using the gap sequences found by main.c.
+//  shellsort_int, shellsort_int64, shellsort_float and shellsort_double sort in place in ascending order.
+//
+//  The gaps are picked from N using the fixed-N sequences in the README (best for average compares).
+//  Between two table sizes the next larger table is used, skipping gaps that are not less than N,
+//  this was as good as or better than gaps_dokken12_222f with computeGoodLastGaps at every size checked.
+//  Above 1 billion gaps_dokken12_222f is used with the first gap from computeGoodLastGaps.
+//  Lookup is a binary search over the table sizes, nothing is allocated.
+//
+
+#ifndef SHELLSORT_H
+#define SHELLSORT_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int64_t
+
+// fixed-N sequences from the README, N=6 through N=45 are the best sequences for average-case
+// every sequence starts with 1 and ends with -1
+static const int64_t shellsort_gaps6[] = {1, 4, -1};
+static const int64_t shellsort_gaps7[] = {1, 5, -1};
+static const int64_t shellsort_gaps8[] = {1, 5, -1};
+static const int64_t shellsort_gaps9[] = {1, 6, -1};
+static const int64_t shellsort_gaps10[] = {1, 6, 9, -1};
+static const int64_t shellsort_gaps11[] = {1, 6, 10, -1};
+static const int64_t shellsort_gaps12[] = {1, 5, -1};
+static const int64_t shellsort_gaps13[] = {1, 5, 12, -1};
+static const int64_t shellsort_gaps14[] = {1, 5, 13, -1};
+static const int64_t shellsort_gaps15[] = {1, 5, 13, -1};
+static const int64_t shellsort_gaps16[] = {1, 5, 14, -1};
+static const int64_t shellsort_gaps17[] = {1, 6, 15, -1};
+static const int64_t shellsort_gaps18[] = {1, 5, 16, -1};
+static const int64_t shellsort_gaps19[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps20[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps21[] = {1, 4, 14, -1};
+static const int64_t shellsort_gaps22[] = {1, 4, 14, 21, -1};
+static const int64_t shellsort_gaps23[] = {1, 4, 14, -1};
+static const int64_t shellsort_gaps24[] = {1, 4, 13, 23, -1};
+static const int64_t shellsort_gaps25[] = {1, 4, 13, 23, -1};
+static const int64_t shellsort_gaps26[] = {1, 4, 14, 25, -1};
+static const int64_t shellsort_gaps27[] = {1, 4, 14, 25, -1};
+static const int64_t shellsort_gaps28[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps29[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps30[] = {1, 4, 13, 29, -1};
+static const int64_t shellsort_gaps31[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps32[] = {1, 4, 13, -1};
+static const int64_t shellsort_gaps33[] = {1, 4, 13, 32, -1};
+static const int64_t shellsort_gaps34[] = {1, 4, 13, 32, -1};
+static const int64_t shellsort_gaps35[] = {1, 4, 13, 33, -1};
+static const int64_t shellsort_gaps36[] = {1, 4, 13, 33, -1};
+static const int64_t shellsort_gaps37[] = {1, 4, 13, 35, -1};
+static const int64_t shellsort_gaps38[] = {1, 4, 13, 36, -1};
+static const int64_t shellsort_gaps39[] = {1, 4, 13, 36, -1};
+static const int64_t shellsort_gaps40[] = {1, 4, 13, 36, -1};
+static const int64_t shellsort_gaps41[] = {1, 4, 13, 36, -1};
+static const int64_t shellsort_gaps42[] = {1, 4, 13, 36, -1};
+static const int64_t shellsort_gaps43[] = {1, 4, 13, 37, -1};
+static const int64_t shellsort_gaps44[] = {1, 4, 13, 41, -1};
+static const int64_t shellsort_gaps45[] = {1, 4, 9, 33, -1};
+static const int64_t shellsort_gaps64[] = {1, 4, 9, 38, 62, -1};
+static const int64_t shellsort_gaps91[] = {1, 4, 9, 33, 86, -1};
+static const int64_t shellsort_gaps128[] = {1, 4, 9, 24, 85, -1};
+static const int64_t shellsort_gaps181[] = {1, 4, 10, 21, 70, 176, -1};
+static const int64_t shellsort_gaps256[] = {1, 4, 10, 27, 89, 238, -1};
+static const int64_t shellsort_gaps362[] = {1, 4, 10, 23, 67, 236, 355, -1};
+static const int64_t shellsort_gaps512[] = {1, 4, 10, 23, 57, 189, 484, -1};
+static const int64_t shellsort_gaps724[] = {1, 4, 10, 23, 57, 145, 479, 719, -1};
+static const int64_t shellsort_gaps1000[] = {1, 4, 10, 23, 57, 156, 409, 996, -1};
+static const int64_t shellsort_gaps2000[] = {1, 4, 10, 23, 57, 132, 347, 1208, 1979, -1};
+static const int64_t shellsort_gaps3000[] = {1, 4, 10, 23, 57, 132, 313, 1044, 2778, -1};
+static const int64_t shellsort_gaps5000[] = {1, 4, 10, 23, 57, 132, 301, 701, 1937, 4921, -1};
+static const int64_t shellsort_gaps10000[] = {1, 4, 10, 23, 57, 132, 301, 701, 1733, 6085, 9941, -1};
+static const int64_t shellsort_gaps20000[] = {1, 4, 10, 23, 57, 132, 301, 701, 1636, 4021, 13293, 19908, -1};
+static const int64_t shellsort_gaps30000[] = {1, 4, 10, 23, 57, 132, 301, 701, 1541, 3498, 11336, 28631, -1};
+static const int64_t shellsort_gaps50000[] = {1, 4, 10, 23, 57, 132, 301, 701, 1504, 3263, 8399, 30113, 49256, -1};
+static const int64_t shellsort_gaps100000[] = {1, 4, 10, 23, 57, 132, 301, 644, 1445, 3165, 6913, 17736, 62185, 99668, -1};
+static const int64_t shellsort_gaps1000000[] = {1, 4, 10, 23, 57, 132, 301, 644, 1408, 3227, 6847, 14917, 32910, 71651, 171523, 606250, 989292, -1};
+static const int64_t shellsort_gaps10000000[] = {1, 4, 10, 23, 57, 132, 301, 644, 1408, 3227, 6847, 14842, 31970, 69487, 149728, 324011, 692843, 1645254, 5934785, 9775485, -1};
+static const int64_t shellsort_gaps100000000[] = {1, 4, 10, 23, 57, 132, 301, 644, 1408, 3227, 6847, 14842, 31970, 68467, 147869, 316034, 667787, 1442593, 3085219, 6662519, 17234807, 60001006, 98743101, -1};
+static const int64_t shellsort_gaps1000000000[] = {1, 4, 10, 23, 57, 132, 301, 644, 1408, 3227, 6847, 14842, 31970, 68467, 147869, 316034, 667787, 1442593, 3085219, 6662519, 14349443, 30994463, 66950617, 167899094, 600000000, 981186611, -1};
+
+// gaps_dokken12_222f, and the last gaps computeGoodLastGaps gives for it
+static const int64_t shellsort_gapsLarge[] = {1, 4, 10, 23, 57, 132, 301, 701, 1504, 3263, 7196, 15948, 34644, 74428, 162005, 347077, 745919, 1599893, 3446017, 7434649, 15933053, 35371377, 78524456, 174324292, 386999928, 859139840, 1907290444, 4234184785, 9399890222, -1};
+static const int64_t shellsort_lastGapsLarge[] = {1, 5, 14, 27, 80, 199, 479, 1059, 2337, 4845, 10712, 23505, 50778, 109807, 237124, 508813, 1092424, 2348032, 5061613, 10883779, 23739714, 52702164, 116998804, 259737345, 576616905, 1280089530, 2841798757, 6308793241, 14005520994, -1};
+
+static const int64_t shellsort_gapsInsertion[] = {1, -1};
+
+typedef struct {
+    int64_t length;
+    const int64_t* gaps;
+} shellsort_table;
+
+// sorted by length
+static const shellsort_table shellsort_tables[] = {
+    {6, shellsort_gaps6},
+    {7, shellsort_gaps7},
+    {8, shellsort_gaps8},
+    {9, shellsort_gaps9},
+    {10, shellsort_gaps10},
+    {11, shellsort_gaps11},
+    {12, shellsort_gaps12},
+    {13, shellsort_gaps13},
+    {14, shellsort_gaps14},
+    {15, shellsort_gaps15},
+    {16, shellsort_gaps16},
+    {17, shellsort_gaps17},
+    {18, shellsort_gaps18},
+    {19, shellsort_gaps19},
+    {20, shellsort_gaps20},
+    {21, shellsort_gaps21},
+    {22, shellsort_gaps22},
+    {23, shellsort_gaps23},
+    {24, shellsort_gaps24},
+    {25, shellsort_gaps25},
+    {26, shellsort_gaps26},
+    {27, shellsort_gaps27},
+    {28, shellsort_gaps28},
+    {29, shellsort_gaps29},
+    {30, shellsort_gaps30},
+    {31, shellsort_gaps31},
+    {32, shellsort_gaps32},
+    {33, shellsort_gaps33},
+    {34, shellsort_gaps34},
+    {35, shellsort_gaps35},
+    {36, shellsort_gaps36},
+    {37, shellsort_gaps37},
+    {38, shellsort_gaps38},
+    {39, shellsort_gaps39},
+    {40, shellsort_gaps40},
+    {41, shellsort_gaps41},
+    {42, shellsort_gaps42},
+    {43, shellsort_gaps43},
+    {44, shellsort_gaps44},
+    {45, shellsort_gaps45},
+    {64, shellsort_gaps64},
+    {91, shellsort_gaps91},
+    {128, shellsort_gaps128},
+    {181, shellsort_gaps181},
+    {256, shellsort_gaps256},
+    {362, shellsort_gaps362},
+    {512, shellsort_gaps512},
+    {724, shellsort_gaps724},
+    {1000, shellsort_gaps1000},
+    {2000, shellsort_gaps2000},
+    {3000, shellsort_gaps3000},
+    {5000, shellsort_gaps5000},
+    {10000, shellsort_gaps10000},
+    {20000, shellsort_gaps20000},
+    {30000, shellsort_gaps30000},
+    {50000, shellsort_gaps50000},
+    {100000, shellsort_gaps100000},
+    {1000000, shellsort_gaps1000000},
+    {10000000, shellsort_gaps10000000},
+    {100000000, shellsort_gaps100000000},
+    {1000000000, shellsort_gaps1000000000},
+};
+
+// sets gaps and lastGaps for sorting n elements, same meaning as in shellSortCustomWithLastGaps
+// the first pass uses the largest lastGaps entry less than n, then gaps below it down to 1
+static inline void shellsort_selectGaps(size_t n, const int64_t** gaps, const int64_t** lastGaps) {
+    const size_t numTables = sizeof(shellsort_tables) / sizeof(shellsort_tables[0]);
+    if (n < (size_t)shellsort_tables[0].length) {
+        *gaps = shellsort_gapsInsertion;
+        *lastGaps = shellsort_gapsInsertion;
+        return;
+    }
+    if (n > (size_t)shellsort_tables[numTables-1].length) {
+        *gaps = shellsort_gapsLarge;
+        *lastGaps = shellsort_lastGapsLarge;
+        return;
+    }
+    
+    // smallest table with length >= n
+    size_t low = 0;
+    size_t high = numTables - 1;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if ((size_t)shellsort_tables[middle].length < n) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    *gaps = shellsort_tables[low].gaps;
+    *lastGaps = shellsort_tables[low].gaps;
+}
+
+// defines static inline void name(type array[], size_t n)
+#define SHELLSORT_DEFINE(name, type) \
+static inline void name(type array[], size_t n) { \
+    if (n < 2) return; \
+    const int64_t* gaps; \
+    const int64_t* lastGaps; \
+    shellsort_selectGaps(n, &gaps, &lastGaps); \
+    int64_t length = (int64_t)n; \
+    \
+    /* find initial gap (largest gap that is less than length) */ \
+    int64_t g = 0; \
+    while (lastGaps[g] < length && lastGaps[g] > 0) { \
+        g++; \
+    } \
+    \
+    int64_t gap = lastGaps[--g]; \
+    while (1) { \
+        for (int64_t i = gap; i < length; i++) { \
+            type temp = array[i]; \
+            int64_t j = i; \
+            while (j >= gap && array[j-gap] > temp) { \
+                array[j] = array[j-gap]; \
+                j -= gap; \
+            } \
+            array[j] = temp; \
+        } \
+        if (g == 0) break; \
+        gap = gaps[--g]; \
+    } \
+}
+
+SHELLSORT_DEFINE(shellsort_int, int)
+SHELLSORT_DEFINE(shellsort_int64, int64_t)
+SHELLSORT_DEFINE(shellsort_float, float)
+SHELLSORT_DEFINE(shellsort_double, double)
+
+#endif // SHELLSORT_H
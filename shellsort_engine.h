@@ -0,0 +1,566 @@
+//
+//  shellsort_engine.h
+//  ShellSort
+//
+//  The sort engine shared by main.c and shellsort_file.c: basic types, the timer and compare counter, cpu and numa placement,
+//  large buffers, the persistent worker pool, the uncounted int and I64 kernels (with the multithreaded ones) and the gaps to use them with.
+//  Defines its functions rather than just declaring them, like shellsort_kernels.h, so include it from one translation unit per program.
+//
+
+#ifndef SHELLSORT_ENGINE_H
+#define SHELLSORT_ENGINE_H
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np, sched_getcpu, CPU_SET
+#endif
+
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, exit
+#include <math.h> // sqrt, pow
+#include <string.h> // memcpy, memset
+#include <sys/time.h> // gettimeofday
+#include <pthread.h> // pthread_create, pthread_join, pthread_t
+#include <inttypes.h> // uint64_t, uint32_t, int64_t
+#include <unistd.h> // sysconf
+#if defined(__unix__) || defined(__APPLE__)
+#define SHELLSORT_HAS_MMAP 1
+#include <sys/mman.h> // mmap, munmap, madvise
+#else
+#define SHELLSORT_HAS_MMAP 0
+#endif
+#if defined(__linux__)
+#include <sched.h> // sched_getcpu, cpu_set_t
+#endif
+
+typedef uint64_t U64;
+typedef uint32_t U32;
+typedef int64_t I64;
+typedef uint16_t U16;
+typedef uint8_t U8;
+
+//static I64 COMPARE_COUNTER = 0;
+static __thread I64 COMPARE_COUNTER = 0;// thread local variable, makes sorting 13% slower but allows each thread to have it's own compare counter, use the *Uncounted kernels for timing
+
+// can be used in qsort
+// returns negative, 0 or positive, does not subtract so it cannot overflow on keys of opposite sign
+int compare_qsort(const void* a, const void* b) {
+    COMPARE_COUNTER++;
+    int x = *(int*)a;
+    int y = *(int*)b;
+    return (x > y) - (x < y);
+}
+
+// returns sign of a - b
+static inline int compareInts(int a, int b) {
+    return compare_qsort(&a, &b);
+    // return a - b;
+}
+
+#define TICKS_PER_SEC 1000000llu
+static inline U64 currentTime(void) {
+    //return clock();
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return ((U64)t.tv_usec) + TICKS_PER_SEC * ((U64)t.tv_sec);
+}
+
+typedef struct {
+    void* array;// element type depends on the kernel instantiation
+    I64 length;
+    I64 gap;
+    I64 blockSize;// residues per block, a multiple of one cache line of elements
+    I64 numBlocks;
+    I64 nextBlock;// next unclaimed block, threads take blocks with an atomic add until none are left
+    I64 fixupFailed;// set by the final pass when an element had to move further than half a block
+} ShellSortParams;
+
+typedef struct {
+    ShellSortParams* params;
+    I64 threadNum;
+    I64 totalThreads;
+    I64 compareCount;
+} __attribute__((aligned(64))) ShellSortThreadArg;// one cache line each, so threads writing compareCount don't false share
+
+// number of online cpus, caps the thread count of the multithreaded kernels
+I64 numOnlineCpus(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    I64 numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus >= 1) {
+        return numCpus;
+    }
+#endif
+    return 64;
+}
+
+// numa placement for the searches and the multithreaded kernels
+// PIN_THREADS pins search workers and pool workers to cpus (linux only, a no-op elsewhere)
+// COMPACT fills the cpus of node 0 first, SPREAD takes one cpu from each node in turn so n threads use every memory controller
+#define PIN_THREADS_OFF 0
+#define PIN_THREADS_COMPACT 1
+#define PIN_THREADS_SPREAD 2
+static int PIN_THREADS = PIN_THREADS_OFF;
+static int USE_HUGE_PAGES = 0;// buffers from allocateLargeBuffer are 2 MB aligned and advised as transparent huge pages (linux only)
+
+#define NUMA_MAX_CPUS 1024
+#define NUMA_MAX_NODES 1024
+#define HUGE_PAGE_BYTES (2LL << 20)
+
+// node and cpu ids can have holes (offline cpus, offline or memory only nodes), so both are kept as lists of the online ids
+typedef struct {
+    int numNodes;
+    int nodes[NUMA_MAX_NODES];// online node ids in increasing order
+    int numCpus;
+    int nodeOfCpu[NUMA_MAX_CPUS];// indexed by cpu id
+    int compactCpus[NUMA_MAX_CPUS];// online cpu ids, all of the first node's cpus, then the next node's, ...
+    int spreadCpus[NUMA_MAX_CPUS];// online cpu ids, first node first cpu, second node first cpu, ..., first node second cpu, ...
+} NumaTopology;
+
+static NumaTopology NUMA_TOPOLOGY;
+
+// reads a linux id list file like "0-3,8,10-11" and sets listed[id] for each id below maxId, returns 0 if it can't be read
+static int readIdList(const char* path, int listed[], int maxId) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int first;
+    while (fscanf(file, "%d", &first) == 1) {
+        int last = first;
+        int c = fgetc(file);
+        if (c == '-') {
+            if (fscanf(file, "%d", &last) != 1) {
+                break;
+            }
+            c = fgetc(file);
+        }
+        for (int id = first; id <= last && id < maxId; id++) {
+            if (id >= 0) {
+                listed[id] = 1;
+            }
+        }
+        if (c != ',') {
+            break;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// reads the online nodes and cpus and each node's cpulist from /sys/devices/system,
+// anything missing (or not linux) leaves cpus 0 to numOnlineCpus()-1 all on node 0
+static void readNumaTopology(void) {
+    NumaTopology* t = &NUMA_TOPOLOGY;
+    static int onlineNodes[NUMA_MAX_NODES];
+    static int onlineCpus[NUMA_MAX_CPUS];
+    int haveNodes = 0;
+    int haveCpus = 0;
+#if defined(__linux__)
+    haveNodes = readIdList("/sys/devices/system/node/online", onlineNodes, NUMA_MAX_NODES);
+    haveCpus = readIdList("/sys/devices/system/cpu/online", onlineCpus, NUMA_MAX_CPUS);
+#endif
+    t->numNodes = 0;
+    for (int node = 0; haveNodes && node < NUMA_MAX_NODES; node++) {
+        if (onlineNodes[node]) {
+            t->nodes[t->numNodes++] = node;
+        }
+    }
+    if (t->numNodes == 0) {
+        t->nodes[t->numNodes++] = 0;
+    }
+    if (!haveCpus) {
+        I64 numCpus = numOnlineCpus() < NUMA_MAX_CPUS ? numOnlineCpus() : NUMA_MAX_CPUS;
+        for (int cpu = 0; cpu < numCpus; cpu++) {
+            onlineCpus[cpu] = 1;
+        }
+    }
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+        t->nodeOfCpu[cpu] = t->nodes[0];
+    }
+#if defined(__linux__)
+    for (int i = 0; haveNodes && i < t->numNodes; i++) {
+        static int cpusOfNode[NUMA_MAX_CPUS];
+        memset(cpusOfNode, 0, sizeof(cpusOfNode));
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", t->nodes[i]);
+        readIdList(path, cpusOfNode, NUMA_MAX_CPUS);
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+            if (cpusOfNode[cpu]) {
+                t->nodeOfCpu[cpu] = t->nodes[i];
+            }
+        }
+    }
+#endif
+    // node by node for compact, round robin over the nodes for spread, each node's cpus in increasing order
+    // a node without cpus (memory only) just never gets a turn
+    t->numCpus = 0;
+    for (int i = 0; i < t->numNodes; i++) {
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+            if (onlineCpus[cpu] && t->nodeOfCpu[cpu] == t->nodes[i]) {
+                t->compactCpus[t->numCpus++] = cpu;
+            }
+        }
+    }
+    if (t->numCpus == 0) {
+        t->compactCpus[t->numCpus++] = 0;
+        t->nodeOfCpu[0] = t->nodes[0];
+    }
+    int numTaken = 0;
+    int taken[NUMA_MAX_CPUS] = {0};
+    while (numTaken < t->numCpus) {
+        for (int i = 0; i < t->numNodes; i++) {
+            for (int k = 0; k < t->numCpus; k++) {
+                int cpu = t->compactCpus[k];
+                if (!taken[cpu] && t->nodeOfCpu[cpu] == t->nodes[i]) {
+                    taken[cpu] = 1;
+                    t->spreadCpus[numTaken++] = cpu;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+NumaTopology const* numaTopology(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, readNumaTopology);
+    return &NUMA_TOPOLOGY;
+}
+
+// cpu the threadNum-th worker is pinned to under PIN_THREADS, -1 when pinning is off
+int pinnedCpu(I64 threadNum) {
+    NumaTopology const* t = numaTopology();
+    if (PIN_THREADS == PIN_THREADS_COMPACT) {
+        return t->compactCpus[threadNum % t->numCpus];
+    }
+    if (PIN_THREADS == PIN_THREADS_SPREAD) {
+        return t->spreadCpus[threadNum % t->numCpus];
+    }
+    return -1;
+}
+
+// pins the calling thread to cpu, returns 0 if that isn't possible here
+int pinCurrentThreadToCpu(int cpu) {
+#if defined(__linux__)
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+#endif
+    (void)cpu;
+    return 0;
+}
+
+// call first thing in a worker so everything it first touches lands on its own node
+void pinWorkerThread(I64 threadNum) {
+    if (PIN_THREADS != PIN_THREADS_OFF) {
+        pinCurrentThreadToCpu(pinnedCpu(threadNum));
+    }
+}
+
+// node of the cpu the calling thread is running on, 0 if unknown
+int currentNumaNode(void) {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && cpu < NUMA_MAX_CPUS) {
+        return numaTopology()->nodeOfCpu[cpu];
+    }
+#endif
+    return 0;
+}
+
+// memory for per-worker sample arrays and shared arrays, untouched until first written so the writing thread decides its node
+// (a heap malloc from the main thread can hand back pages the main thread already touched), free with freeLargeBuffer
+void* allocateLargeBuffer(I64 bytes) {
+#if SHELLSORT_HAS_MMAP
+    I64 mappedBytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    if (USE_HUGE_PAGES) {
+        // map one extra huge page so the buffer can start on a 2 MB boundary, then give back the unaligned ends
+        char* raw = mmap(NULL, (size_t)(mappedBytes + HUGE_PAGE_BYTES), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (raw == MAP_FAILED) {
+            printf("error 494\n");
+            exit(1);
+        }
+        char* aligned = (char*)(((U64)raw + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES);
+        if (aligned > raw) {
+            munmap(raw, (size_t)(aligned - raw));
+        }
+        munmap(aligned + mappedBytes, (size_t)(raw + HUGE_PAGE_BYTES - aligned));
+#ifdef MADV_HUGEPAGE
+        madvise(aligned, (size_t)mappedBytes, MADV_HUGEPAGE);
+#endif
+        return aligned;
+    }
+    void* buffer = mmap(NULL, (size_t)mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (buffer == MAP_FAILED) {
+        printf("error 509\n");
+        exit(1);
+    }
+    return buffer;
+#else
+    return malloc(bytes);
+#endif
+}
+
+void freeLargeBuffer(void* buffer, I64 bytes) {
+#if SHELLSORT_HAS_MMAP
+    I64 mappedBytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    munmap(buffer, (size_t)mappedBytes);
+#else
+    (void)bytes;
+    free(buffer);
+#endif
+}
+
+// persistent worker pool for the multithreaded kernels and the searches, its threads are reused for every job
+// the kernels share one pool for the whole process, see acquireShellSortPool
+// shellSortPoolRun hands a job to the first numThreads workers and waits until all of them are done
+typedef void (*ShellSortPoolJob)(void* context, I64 threadNum);
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    pthread_t* threads;
+    I64 numWorkers;
+    
+    // protected by mutex
+    U64 generation;// incremented for every job, workers wait for it to change
+    I64 numActive;
+    I64 numRemaining;
+    int shutdown;
+    ShellSortPoolJob job;
+    void* context;
+} ShellSortPool;
+
+typedef struct {
+    ShellSortPool* pool;
+    I64 threadNum;
+} ShellSortPoolWorkerArg;
+
+void* thread_shellSortPoolWorker(void* arg_) {
+    ShellSortPoolWorkerArg* arg = arg_;
+    ShellSortPool* pool = arg->pool;
+    I64 threadNum = arg->threadNum;
+    free(arg);
+    pinWorkerThread(threadNum);
+    
+    U64 seenGeneration = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        while (pool->generation == seenGeneration && !pool->shutdown) {
+            pthread_cond_wait(&pool->workReady, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seenGeneration = pool->generation;
+        if (threadNum >= pool->numActive) {
+            continue;
+        }
+        ShellSortPoolJob job = pool->job;
+        void* context = pool->context;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        job(context, threadNum);
+        
+        pthread_mutex_lock(&pool->mutex);
+        pool->numRemaining--;
+        if (pool->numRemaining == 0) {
+            pthread_cond_signal(&pool->workDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+ShellSortPool* shellSortPoolCreate(I64 numWorkers) {
+    ShellSortPool* pool = malloc(sizeof(ShellSortPool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+    pool->generation = 0;
+    pool->numActive = 0;
+    pool->numRemaining = 0;
+    pool->shutdown = 0;
+    pool->numWorkers = numWorkers;
+    pool->threads = malloc(sizeof(pthread_t) * numWorkers);
+    for (I64 i = 0; i < numWorkers; i++) {
+        ShellSortPoolWorkerArg* arg = malloc(sizeof(ShellSortPoolWorkerArg));
+        arg->pool = pool;
+        arg->threadNum = i;
+        pthread_create(&pool->threads[i], NULL, thread_shellSortPoolWorker, arg);
+    }
+    return pool;
+}
+
+void shellSortPoolRun(ShellSortPool* pool, ShellSortPoolJob job, void* context, I64 numThreads) {
+    if (numThreads > pool->numWorkers) {
+        numThreads = pool->numWorkers;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->job = job;
+    pool->context = context;
+    pool->numActive = numThreads;
+    pool->numRemaining = numThreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workReady);
+    while (pool->numRemaining > 0) {
+        pthread_cond_wait(&pool->workDone, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void shellSortPoolDestroy(ShellSortPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->mutex);
+    for (I64 i = 0; i < pool->numWorkers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_cond_destroy(&pool->workDone);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+// one pool with a worker per online cpu shared by the multithreaded kernels for the life of the process, created on first use,
+// so repeated sorts don't create and join threads; a sort that finds it in use by another thread gets a private pool instead
+static ShellSortPool* sharedShellSortPool = NULL;
+static pthread_mutex_t sharedShellSortPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t sharedShellSortPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedShellSortPool(void) {
+    sharedShellSortPool = shellSortPoolCreate(numOnlineCpus());
+}
+
+// pool with at least numThreads workers for one sort, hand it back with releaseShellSortPool
+ShellSortPool* acquireShellSortPool(I64 numThreads) {
+    if (numThreads <= numOnlineCpus() && pthread_mutex_trylock(&sharedShellSortPoolLock) == 0) {
+        pthread_once(&sharedShellSortPoolOnce, createSharedShellSortPool);
+        return sharedShellSortPool;
+    }
+    return shellSortPoolCreate(numThreads);
+}
+
+void releaseShellSortPool(ShellSortPool* pool) {
+    if (pool == sharedShellSortPool) {
+        pthread_mutex_unlock(&sharedShellSortPoolLock);
+    }
+    else {
+        shellSortPoolDestroy(pool);
+    }
+}
+
+// minimum elements per thread before a pass is split across threads, measured once, defined after the kernels
+I64 shellSortParallelMinLength(void);
+
+// shellSortCustomWithLastGapsBlocked gathers chains into contiguous scratch for passes with at least this gap
+// measured per pass at N=1e8, smaller gaps were slower blocked, the hardware prefetcher keeps up with the plain pass there
+#define SHELLSORT_BLOCKED_MIN_GAP 131072
+#define SHELLSORT_BLOCKED_MIN_CHAIN 16 // with shorter chains the plain pass is a few sequential streams and needs no blocking
+#define SHELLSORT_BLOCKED_TILE_BYTES 64 // one cache line of consecutive chains is gathered at a time
+
+// uncounted kernels with an inlined compare, used for wall-clock timing
+#define KERNEL_SUFFIX Uncounted
+#include "shellsort_kernels.h"
+
+// uncounted I64 kernels, compares use the key directly so they cannot overflow
+#define KERNEL_SUFFIX I64
+#define KERNEL_TYPE I64
+#include "shellsort_kernels.h"
+
+static void shellSortNoopJob(void* context, I64 threadNum) {
+    (void)context;
+    (void)threadNum;
+}
+
+static I64 _shellSortParallelMinLength;
+
+// times one insert of a gap pass against one round trip through a 2 thread pool, a pass is only split when every
+// thread has at least 20 round trips worth of inserts, so the handoff costs under 5% of the work
+static void calibrateShellSortParallelMinLength(void) {
+    const I64 length = 1 << 16;
+    const I64 gap = 1 << 10;
+    const int numRoundTrips = 200;
+    int* array = malloc(sizeof(int) * length);
+    U32 x = 12345;// local lcg so the calibration doesn't advance the caller's pcg stream
+    for (I64 i = 0; i < length; i++) {
+        x = x * 1664525u + 1013904223u;
+        array[i] = (int)(x >> 1);
+    }
+    U64 startTime = currentTime();
+    shellSortSingleGapUncounted(array, length, gap);
+    double insertTime = (double)(currentTime() - startTime) / (length - gap);
+    
+    ShellSortPool* pool = shellSortPoolCreate(2);
+    startTime = currentTime();
+    for (int i = 0; i < numRoundTrips; i++) {
+        shellSortPoolRun(pool, shellSortNoopJob, NULL, 2);
+    }
+    double roundTripTime = (double)(currentTime() - startTime) / numRoundTrips;
+    shellSortPoolDestroy(pool);
+    free(array);
+    
+    if (insertTime <= 0) {
+        insertTime = 1.0 / TICKS_PER_SEC;// one ns per insert if the pass was too fast for the timer
+    }
+    double minLength = 20 * roundTripTime / insertTime;
+    _shellSortParallelMinLength = minLength > 4096 ? (I64)minLength : 4096;
+}
+
+I64 shellSortParallelMinLength(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, calibrateShellSortParallelMinLength);
+    return _shellSortParallelMinLength;
+}
+
+// computed experimentally for minimizing compares, arraySize~=lastGap*8000/301, with 2 extra gaps with randRatio in [2.5,2.9] then [2.7,3.3]
+// has ratios: 4.000, 2.500, 2.300, 2.478, 2.316, 2.280, 2.329, 2.146, 2.170, 2.205, 2.216, 2.172, 2.148, 2.177, 2.142, 2.149, 2.145, 2.154, 2.157, 2.143, 2.22, 2.22, 2.22, 2.22, 2.22
+// experimentally computed until 15933053, then extending with constant ratio 2.22 rounded down to nearest integer
+static const I64 gaps_dokken12_222f[] = {1, 4, 10, 23, 57, 132, 301, 701, 1504, 3263, 7196, 15948, 34644, 74428, 162005, 347077, 745919, 1599893, 3446017, 7434649, 15933053, 35371377, 78524456, 174324292, 386999928, 859139840, 1907290444, 4234184785, 9399890222, -1};
+
+// computes a "good" lastGaps sequence corresponding to passed in gaps
+// uses precomputed good last gaps while following ciura+1504+3263 gaps 1, 4, ..., 701, 1504, 3263
+// otherwise uses geometric mean
+// output in lastGaps
+// assumes gaps ends in -1 or any negative number
+// assumes length of lastGaps is as long as input gaps, but not more than 32 long
+// will put -1 at end of lastGaps sequence
+void computeGoodLastGaps(const I64 gaps[], I64 lastGaps[]) {
+    lastGaps[0] = 1;
+    
+    static const I64 precomputedGaps[] =     {1, 4, 10, 23, 57, 132, 301,  701, 1504, 3263};
+    static const I64 precomputedLastGaps[] = {1, 5, 14, 27, 80, 199, 479, 1059, 2337};
+    
+    I64 numPrecomputed = sizeof(precomputedLastGaps) / sizeof(I64);
+    
+    I64 i = 1;
+    while (i < numPrecomputed && gaps[i] == precomputedGaps[i] && gaps[i+1] == precomputedGaps[i+1]) {
+        lastGaps[i] = precomputedLastGaps[i];
+        i++;
+    }
+    
+    while (gaps[i] >= 0 && i < 32) {
+        double g;
+        if (gaps[i+1] >= 0) {
+            g = sqrt(gaps[i] * (double)gaps[i+1]);
+        }
+        else {
+            g = pow(gaps[i], 1.5) / sqrt(gaps[i-1]);
+        }
+        
+        lastGaps[i] = g;
+        i++;
+    }
+    if (i >= 32) {
+        printf("error 1255, maybe gaps are too long or do not end with -1\n");
+        exit(1);
+    }
+    lastGaps[i] = -1;
+}
+
+#endif // SHELLSORT_ENGINE_H
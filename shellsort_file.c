@@ -0,0 +1,160 @@
+//
+//  shellsort_file.c
+//  ShellSort
+//
+//  Sorts a binary file of native-endian int32 or int64 keys in place through mmap,
+//  using the multithreaded gap engine with gaps_dokken12_222f and computeGoodLastGaps.
+//  Indices are 64-bit throughout, so files with more than 2^32 elements are fine.
+//
+//  build: gcc -O3 -o shellsort-file shellsort_file.c -lm -lpthread
+//  usage: ./shellsort-file <file> <int32|int64> [maxThreads]
+//
+//  Needs mmap, so it builds on MacOS and Linux but not with the Windows compiler in Codeblocks.
+//
+
+#include "shellsort_engine.h" // multithreaded kernels, gaps_dokken12_222f, computeGoodLastGaps
+
+#include <sys/mman.h> // mmap, madvise, msync, munmap
+#include <sys/stat.h> // fstat
+#include <sys/resource.h> // getrusage
+#include <fcntl.h> // open
+
+typedef struct {
+    I64 minorFaults;
+    I64 majorFaults;
+} PageFaults;
+
+static PageFaults currentPageFaults(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    PageFaults faults = {usage.ru_minflt, usage.ru_majflt};
+    return faults;
+}
+
+// isArraySorted in main.c rejects duplicates, files can have them
+static int isFileSortedInt32(int const array[], I64 length) {
+    for (I64 i = 1; i < length; i++) {
+        if (array[i-1] > array[i]) return 0;
+    }
+    return 1;
+}
+
+static int isFileSortedInt64(I64 const array[], I64 length) {
+    for (I64 i = 1; i < length; i++) {
+        if (array[i-1] > array[i]) return 0;
+    }
+    return 1;
+}
+
+static void printPhase(const char* name, U64 startTime, PageFaults startFaults, I64 numBytes) {
+    U64 elapsed = currentTime() - startTime;
+    PageFaults faults = currentPageFaults();
+    double seconds = elapsed / (double)TICKS_PER_SEC;
+    printf("%-6s %10.3f seconds, %10.1f MB/s, %lld minor faults, %lld major faults\n", name, seconds,
+           seconds > 0 ? numBytes / seconds / 1e6 : 0.0,
+           faults.minorFaults - startFaults.minorFaults, faults.majorFaults - startFaults.majorFaults);
+}
+
+int main(int argc, const char * argv[]) {
+    if (argc < 3) {
+        printf("usage: %s <file> <int32|int64> [maxThreads]\n", argv[0]);
+        return 1;
+    }
+    I64 elementSize;
+    if (strcmp(argv[2], "int32") == 0) {
+        elementSize = 4;
+    }
+    else if (strcmp(argv[2], "int64") == 0) {
+        elementSize = 8;
+    }
+    else {
+        printf("error 71, key type must be int32 or int64\n");
+        return 1;
+    }
+    I64 maxThreads = argc > 3 ? atoll(argv[3]) : numOnlineCpus();
+    if (maxThreads < 1) {
+        maxThreads = 1;
+    }
+
+    int fd = open(argv[1], O_RDWR);
+    if (fd < 0) {
+        printf("error 81, can't open %s\n", argv[1]);
+        return 1;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        printf("error 86\n");
+        close(fd);
+        return 1;
+    }
+    I64 numBytes = fileStat.st_size;
+    if (numBytes % elementSize != 0) {
+        printf("error 92, file size %lld is not a multiple of %lld\n", numBytes, elementSize);
+        close(fd);
+        return 1;
+    }
+    I64 length = numBytes / elementSize;
+    printf("%s: %lld %s keys, %lld threads\n", argv[1], length, argv[2], maxThreads);
+    if (length < 2) {
+        close(fd);
+        return 0;
+    }
+
+    void* data = mmap(NULL, (size_t)numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("error 105, mmap failed\n");
+        close(fd);
+        return 1;
+    }
+
+    // every pass touches every page, so ask for the whole file to be read ahead now
+    madvise(data, (size_t)numBytes, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    madvise(data, (size_t)numBytes, MADV_HUGEPAGE);// linux only, fewer tlb misses on the large gap passes if the filesystem supports it
+#endif
+
+    // fault every page in before the sort so the sort phase measures sorting rather than disk reads
+    U64 startTime = currentTime();
+    PageFaults startFaults = currentPageFaults();
+    volatile U8 sink = 0;
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for (I64 i = 0; i < numBytes; i += pageSize) {
+        sink ^= ((U8*)data)[i];
+    }
+    (void)sink;
+    printPhase("load", startTime, startFaults, numBytes);
+
+    I64 lastGaps[32];
+    computeGoodLastGaps(gaps_dokken12_222f, lastGaps);
+
+    startTime = currentTime();
+    startFaults = currentPageFaults();
+    if (elementSize == 4) {
+        shellSortCustomWithLastGapsMultithreadedUncounted(data, length, gaps_dokken12_222f, lastGaps, maxThreads);
+    }
+    else {
+        shellSortCustomWithLastGapsMultithreadedI64(data, length, gaps_dokken12_222f, lastGaps, maxThreads);
+    }
+    U64 sortTime = currentTime() - startTime;
+    printPhase("sort", startTime, startFaults, numBytes);
+
+    startTime = currentTime();
+    startFaults = currentPageFaults();
+    if (msync(data, (size_t)numBytes, MS_SYNC) != 0) {
+        printf("error 144, msync failed\n");
+        munmap(data, (size_t)numBytes);
+        close(fd);
+        return 1;
+    }
+    printPhase("msync", startTime, startFaults, numBytes);
+
+    int sorted = (elementSize == 4) ? isFileSortedInt32(data, length) : isFileSortedInt64(data, length);
+    munmap(data, (size_t)numBytes);
+    close(fd);
+    if (!sorted) {
+        printf("error 155\n");
+        return 1;
+    }
+    printf("sorted, %.2f million keys/s\n", sortTime > 0 ? length / (sortTime / (double)TICKS_PER_SEC) / 1e6 : 0.0);
+    return 0;
+}
@@ -0,0 +1,695 @@
+//
+//  shellsort_kernels.h
+//  ShellSort
+//
+//  Template for the int sort kernels, included once per instantiation from shellsort_engine.h and main.c.
+//  Before including, define KERNEL_SUFFIX (appended to every kernel name, may be empty),
+//  optionally KERNEL_TYPE (element type, defaults to int, KERNEL_COUNT_TLS only works with int)
+//  and KERNEL_KEY(x) (the value elements are ordered by, defaults to x itself, e.g. (x).key for records),
+//  and at most one counting mode:
+//    KERNEL_COUNT_TLS       every comparison goes through compareInts and increments COMPARE_COUNTER
+//    KERNEL_COUNT_LOCAL     comparisons are counted in a local accumulator and each kernel returns the count as an I64
+//    (neither)              plain inlined compare, kernels count nothing
+//  All of these macros are undefined again at the end of this file.
+//
+
+#define KERNEL_CONCAT_(a, b) a ## b
+#define KERNEL_CONCAT(a, b) KERNEL_CONCAT_(a, b)
+#define KERNEL(name) KERNEL_CONCAT(name, KERNEL_SUFFIX)
+
+#ifndef KERNEL_TYPE
+#define KERNEL_TYPE int
+#endif
+#ifndef KERNEL_KEY
+#define KERNEL_KEY(x) (x)
+#endif
+
+#if defined(KERNEL_COUNT_LOCAL)
+#define KERNEL_RET I64
+#define KERNEL_COUNT_BEGIN I64 compares = 0;
+#define KERNEL_GREATER(a, b) (compares++, KERNEL_KEY(a) > KERNEL_KEY(b))
+#define KERNEL_COUNT_ADD(x) (compares += (x))
+#define KERNEL_COUNT_ADD_THREAD(x) (compares += (x))
+#define KERNEL_COUNT_RETURN return compares
+#define KERNEL_THREAD_COUNT compares
+#else
+#define KERNEL_RET void
+#define KERNEL_COUNT_BEGIN
+#define KERNEL_COUNT_ADD(x) (x)
+#define KERNEL_COUNT_RETURN return
+#if defined(KERNEL_COUNT_TLS)
+#define KERNEL_GREATER(a, b) (compareInts(a, b) > 0)
+#define KERNEL_COUNT_ADD_THREAD(x) (COMPARE_COUNTER += (x))
+#define KERNEL_THREAD_COUNT COMPARE_COUNTER
+#else
+#define KERNEL_GREATER(a, b) (KERNEL_KEY(a) > KERNEL_KEY(b))
+#define KERNEL_COUNT_ADD_THREAD(x) ((void)(x))
+#define KERNEL_THREAD_COUNT 0
+#endif
+#endif
+
+// assumes we are sorting ints
+KERNEL_RET KERNEL(insertionSort)(KERNEL_TYPE array[], I64 length) {
+    KERNEL_COUNT_BEGIN
+    for (I64 i = 1; i < length; i++) {// i is index of element we need to insert
+        KERNEL_TYPE temp = array[i];
+        I64 j = i-1;
+        while (1) {
+            if (KERNEL_GREATER(array[j], temp)) {
+                array[j+1] = array[j];
+            }
+            else {
+                array[j+1] = temp;
+                break;
+            }
+            if (j == 0) {
+                array[0] = temp;
+                break;
+            }
+            j--;
+        }
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// assumes first element in gaps/lastGaps is 1, last element in gaps/lastGaps is -1
+KERNEL_RET KERNEL(shellSortCustomWithLastGaps)(KERNEL_TYPE array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    KERNEL_COUNT_BEGIN
+    // find initial gap (largest gap that is less than length)
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    
+    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
+        for (I64 i = gap; i < length; i++) {// i is index of element we need to insert
+            KERNEL_TYPE temp = array[i];
+            I64 j = i-gap;
+            I64 j2 = i;
+            while (1) {
+                if (KERNEL_GREATER(array[j], temp)) {
+                    array[j2] = array[j];
+                }
+                else {
+                    array[j2] = temp;
+                    break;
+                }
+                if (j < gap) {
+                    array[j] = temp;
+                    break;
+                }
+                j2 = j - gap;
+                
+                // swap places of j and j2 and repeat what is above
+                
+                if (KERNEL_GREATER(array[j2], temp)) {
+                    array[j] = array[j2];
+                }
+                else {
+                    array[j] = temp;
+                    break;
+                }
+                if (j2 < gap) {
+                    array[j2] = temp;
+                    break;
+                }
+                j = j2 - gap;
+            }
+        }
+    }
+    
+    KERNEL_COUNT_ADD(KERNEL(insertionSort)(array, length));
+    KERNEL_COUNT_RETURN;
+}
+
+// assumes first element in gaps is 1, last element in gaps is -1
+KERNEL_RET KERNEL(shellSortCustom)(KERNEL_TYPE array[], I64 length, const I64 gaps[]) {
+    return KERNEL(shellSortCustomWithLastGaps)(array, length, gaps, gaps);
+}
+
+// insert element at index i
+static KERNEL_RET KERNEL(shellSortSingleInsert)(KERNEL_TYPE array[], I64 gap, I64 i) {
+    KERNEL_COUNT_BEGIN
+    KERNEL_TYPE temp = array[i];
+    I64 j = i-gap;
+    I64 j2 = i;
+    while (1) {
+        if (KERNEL_GREATER(array[j], temp)) {
+            array[j2] = array[j];
+        }
+        else {
+            array[j2] = temp;
+            KERNEL_COUNT_RETURN;
+        }
+        if (j < gap) {
+            array[j] = temp;
+            KERNEL_COUNT_RETURN;
+        }
+        j2 = j - gap;
+        
+        // swap places of j and j2 and repeat what is above
+        
+        if (KERNEL_GREATER(array[j2], temp)) {
+            array[j] = array[j2];
+        }
+        else {
+            array[j] = temp;
+            KERNEL_COUNT_RETURN;
+        }
+        if (j2 < gap) {
+            array[j2] = temp;
+            KERNEL_COUNT_RETURN;
+        }
+        j = j2 - gap;
+    }
+}
+
+static KERNEL_RET KERNEL(shellSortSingleGap)(KERNEL_TYPE array[], I64 length, I64 gap) {
+    KERNEL_COUNT_BEGIN
+    for (I64 i = gap; i < length; i++) {// i is index of element we need to insert
+        KERNEL_COUNT_ADD(KERNEL(shellSortSingleInsert)(array, gap, i));
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// pool job for one pass, threads claim blocks of params->blockSize consecutive residues until none are left
+// within a block the rows are inserted in order, so each row is one contiguous run of the array
+// block widths are whole cache lines but rows start at multiples of gap, so neighbouring blocks can share the line at their edge,
+// at most one line per row per edge; a thread that finishes early just claims the next unfinished block
+void KERNEL(shellSortThreadFunc)(void* context, I64 threadNum) {
+    ShellSortThreadArg* arg = &((ShellSortThreadArg*)context)[threadNum];
+    ShellSortParams* params = arg->params;
+    
+    KERNEL_COUNT_BEGIN
+#if defined(KERNEL_COUNT_TLS)
+    I64 startCount = COMPARE_COUNTER;
+#endif
+    
+    I64 gap = params->gap;
+    I64 length = params->length;
+    KERNEL_TYPE* array = params->array;
+    
+    while (1) {
+        I64 block = __atomic_fetch_add(&params->nextBlock, 1, __ATOMIC_RELAXED);
+        if (block >= params->numBlocks) {
+            break;
+        }
+        I64 firstResidue = block * params->blockSize;
+        I64 lastResidue = firstResidue + params->blockSize;
+        if (lastResidue > gap) {
+            lastResidue = gap;
+        }
+        for (I64 base = gap; base + firstResidue < length; base += gap) {
+            I64 end = base + lastResidue;
+            if (end > length) {
+                end = length;
+            }
+            for (I64 i = base + firstResidue; i < end; i++) {
+                KERNEL_COUNT_ADD(KERNEL(shellSortSingleInsert)(array, gap, i));
+            }
+        }
+    }
+    
+#if defined(KERNEL_COUNT_TLS)
+    arg->compareCount = COMPARE_COUNTER - startCount;
+#else
+    arg->compareCount = KERNEL_THREAD_COUNT;
+#endif
+}
+
+// pool job for the first half of the final gap 1 pass, insertion sorts each block of params->blockSize consecutive elements
+void KERNEL(shellSortFinalBlockFunc)(void* context, I64 threadNum) {
+    ShellSortThreadArg* arg = &((ShellSortThreadArg*)context)[threadNum];
+    ShellSortParams* params = arg->params;
+    
+    KERNEL_COUNT_BEGIN
+#if defined(KERNEL_COUNT_TLS)
+    I64 startCount = COMPARE_COUNTER;
+#endif
+    
+    KERNEL_TYPE* array = params->array;
+    while (1) {
+        I64 block = __atomic_fetch_add(&params->nextBlock, 1, __ATOMIC_RELAXED);
+        if (block >= params->numBlocks) {
+            break;
+        }
+        I64 start = block * params->blockSize;
+        I64 end = start + params->blockSize;
+        if (end > params->length) {
+            end = params->length;
+        }
+        KERNEL_COUNT_ADD(KERNEL(insertionSort)(array + start, end - start));
+    }
+    
+#if defined(KERNEL_COUNT_TLS)
+    arg->compareCount = COMPARE_COUNTER - startCount;
+#else
+    arg->compareCount = KERNEL_THREAD_COUNT;
+#endif
+}
+
+// pool job for the second half of the final gap 1 pass, merges across each block boundary b by inserting the head of the right block
+// into the tail of the left block until an element doesn't move, at that point the rest of the right block is already in place
+// every fixup stays inside [b - blockSize/2, b + blockSize/2) so boundaries never touch each other's elements,
+// since the earlier passes leave every element close to its final position this almost never overflows,
+// when it does params->fixupFailed is set and the caller finishes with a serial insertion sort
+void KERNEL(shellSortFinalFixupFunc)(void* context, I64 threadNum) {
+    ShellSortThreadArg* arg = &((ShellSortThreadArg*)context)[threadNum];
+    ShellSortParams* params = arg->params;
+    
+    KERNEL_COUNT_BEGIN
+#if defined(KERNEL_COUNT_TLS)
+    I64 startCount = COMPARE_COUNTER;
+#endif
+    
+    KERNEL_TYPE* array = params->array;
+    I64 halfBlock = params->blockSize / 2;
+    while (1) {
+        I64 boundary = __atomic_fetch_add(&params->nextBlock, 1, __ATOMIC_RELAXED) + 1;
+        if (boundary >= params->numBlocks) {
+            break;
+        }
+        I64 b = boundary * params->blockSize;
+        I64 lo = b - halfBlock + 1;// array[lo-1] is read but never written
+        I64 hi = b + halfBlock;
+        if (hi > params->length) {
+            hi = params->length;
+        }
+        I64 i = b;
+        for (; i < hi; i++) {
+            KERNEL_TYPE temp = array[i];
+            I64 j = i;
+            while (j > lo && KERNEL_GREATER(array[j-1], temp)) {
+                array[j] = array[j-1];
+                j--;
+            }
+            array[j] = temp;
+            if (j == i) {
+                break;
+            }
+            if (j == lo && KERNEL_GREATER(array[lo-1], temp)) {
+                __atomic_store_n(&params->fixupFailed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        if (i == hi && hi < params->length) {
+            __atomic_store_n(&params->fixupFailed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+#if defined(KERNEL_COUNT_TLS)
+    arg->compareCount = COMPARE_COUNTER - startCount;
+#else
+    arg->compareCount = KERNEL_THREAD_COUNT;
+#endif
+}
+
+// passes are split across a pool of up to maxThreads threads (capped at the number of online cpus) created once for the whole sort
+// a pass is split only when every thread gets at least shellSortParallelMinLength() elements and one block of residues
+KERNEL_RET KERNEL(shellSortCustomWithLastGapsMultithreaded)(KERNEL_TYPE array[], I64 length, const I64 gaps[], const I64 lastGaps[], I64 maxThreads) {
+    KERNEL_COUNT_BEGIN
+    const I64 minLengthPerThread = shellSortParallelMinLength();
+    if (maxThreads > numOnlineCpus()) {
+        maxThreads = numOnlineCpus();
+    }
+    if (length < 2 * minLengthPerThread || maxThreads <= 1) {
+        return KERNEL(shellSortCustomWithLastGaps)(array, length, gaps, lastGaps);
+    }
+    
+    // blocks are whole cache lines of residues, aiming for 8 blocks per thread so early finishers have something to take
+    const I64 lineElements = (64 / (I64)sizeof(KERNEL_TYPE) > 1) ? 64 / (I64)sizeof(KERNEL_TYPE) : 1;
+    
+    ShellSortParams params;
+    params.array = array;
+    params.length = length;
+    ShellSortThreadArg* threadArgs = malloc(sizeof(ShellSortThreadArg) * maxThreads);
+    for (I64 i = 0; i < maxThreads; i++) {
+        threadArgs[i].params = &params;
+        threadArgs[i].threadNum = i;
+    }
+    ShellSortPool* pool = NULL;
+    
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    g--;
+    
+    I64 gap = lastGaps[g];
+    do {
+        I64 numThreadsToUse = maxThreads;
+        if (numThreadsToUse > gap / lineElements) {
+            numThreadsToUse = gap / lineElements;
+        }
+        if (numThreadsToUse > (length - gap) / minLengthPerThread) {
+            numThreadsToUse = (length - gap) / minLengthPerThread;
+        }
+        //printf("sort gap=%d, numThreadsToUse=%d\n", gap, numThreadsToUse);
+        if (numThreadsToUse > 1) {
+            if (pool == NULL) {
+                pool = acquireShellSortPool(maxThreads);
+            }
+            I64 blockSize = (gap + 8 * numThreadsToUse - 1) / (8 * numThreadsToUse);
+            blockSize = (blockSize + lineElements - 1) / lineElements * lineElements;
+            params.gap = gap;
+            params.blockSize = blockSize;
+            params.numBlocks = (gap + blockSize - 1) / blockSize;
+            params.nextBlock = 0;
+            for (I64 i = 0; i < numThreadsToUse; i++) {
+                threadArgs[i].totalThreads = numThreadsToUse;
+            }
+            shellSortPoolRun(pool, KERNEL(shellSortThreadFunc), threadArgs, numThreadsToUse);
+            for (I64 i = 0; i < numThreadsToUse; i++) {
+                KERNEL_COUNT_ADD_THREAD(threadArgs[i].compareCount);
+            }
+        }
+        else {
+            KERNEL_COUNT_ADD(KERNEL(shellSortSingleGap)(array, length, gap));
+        }
+        g--;
+        gap = gaps[g];
+    }
+    while (g > 0);
+    
+    // final gap 1 pass, blocks are insertion sorted in parallel and then every block boundary is fixed up in parallel
+    I64 numThreadsToUse = maxThreads;
+    if (numThreadsToUse > length / minLengthPerThread) {
+        numThreadsToUse = length / minLengthPerThread;
+    }
+    if (pool == NULL) {
+        pool = acquireShellSortPool(maxThreads);
+    }
+    I64 blockSize = (length + 8 * numThreadsToUse - 1) / (8 * numThreadsToUse);
+    if (blockSize < minLengthPerThread) {
+        blockSize = minLengthPerThread;
+    }
+    params.blockSize = blockSize;
+    params.numBlocks = (length + blockSize - 1) / blockSize;
+    params.nextBlock = 0;
+    params.fixupFailed = 0;
+    for (I64 i = 0; i < numThreadsToUse; i++) {
+        threadArgs[i].totalThreads = numThreadsToUse;
+    }
+    shellSortPoolRun(pool, KERNEL(shellSortFinalBlockFunc), threadArgs, numThreadsToUse);
+    for (I64 i = 0; i < numThreadsToUse; i++) {
+        KERNEL_COUNT_ADD_THREAD(threadArgs[i].compareCount);
+    }
+    params.nextBlock = 0;
+    shellSortPoolRun(pool, KERNEL(shellSortFinalFixupFunc), threadArgs, numThreadsToUse);
+    for (I64 i = 0; i < numThreadsToUse; i++) {
+        KERNEL_COUNT_ADD_THREAD(threadArgs[i].compareCount);
+    }
+    
+    releaseShellSortPool(pool);
+    free(threadArgs);
+    
+    if (params.fixupFailed) {
+        KERNEL_COUNT_ADD(KERNEL(insertionSort)(array, length));
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// assumes first element in gaps is 1 and second element in gaps is positive, last element in gaps is -1
+KERNEL_RET KERNEL(shellSortCustomAdjustLast)(KERNEL_TYPE array[], I64 length, I64 const gaps[]) {
+    KERNEL_COUNT_BEGIN
+    
+    if (length <= gaps[1]) {
+        return KERNEL(insertionSort)(array, length);
+    }
+    
+    // find initial gap (largest gap that is less than length)
+    I64 g = 2;
+    while (gaps[g] < length && gaps[g] > 0) {
+        g++;
+    }
+    g--;
+    
+    I64 gap;
+    gap = sqrt(gaps[g] * (double)gaps[g+1]);
+    if (gap >= length) {
+        g--;
+        gap = sqrt(gaps[g] * (double)gaps[g+1]);
+    }
+    
+    do {
+        KERNEL_COUNT_ADD(KERNEL(shellSortSingleGap)(array, length, gap));
+        g--;
+        gap = gaps[g];
+    }
+    while (g > 0);
+    
+    KERNEL_COUNT_ADD(KERNEL(insertionSort)(array, length));
+    KERNEL_COUNT_RETURN;
+}
+
+// binary insertion pass, for expensive compares
+// finds each insertion point in the sorted part of its chain by comparing at offsets 1, 2, 4, 8, ... back from the element,
+// then binary searching between the last greater offset and the first offset that is not greater
+// an element already in place still costs 1 compare, a search over the whole sorted part would cost log2 of its length
+// uses fewer compares than shellSortSingleGap when elements move far and slightly more when they move 2 positions, moves are the same
+static KERNEL_RET KERNEL(shellSortSingleGapBinary)(KERNEL_TYPE array[], I64 length, I64 gap) {
+    KERNEL_COUNT_BEGIN
+    for (I64 i = gap; i < length; i++) {// i is index of element we need to insert
+        KERNEL_TYPE temp = array[i];
+        I64 numSorted = i / gap;// sorted elements before i in its chain
+        I64 low = 0;// elements at offsets 1..low are greater than temp
+        I64 high;// element at offset high is not greater than temp, or high is past the start of the chain
+        I64 step = 1;
+        while (1) {
+            if (step > numSorted) {
+                high = numSorted + 1;
+                break;
+            }
+            if (KERNEL_GREATER(array[i - step*gap], temp)) {
+                low = step;
+                step *= 2;
+            }
+            else {
+                high = step;
+                break;
+            }
+        }
+        while (high - low > 1) {
+            I64 middle = low + (high - low) / 2;
+            if (KERNEL_GREATER(array[i - middle*gap], temp)) {
+                low = middle;
+            }
+            else {
+                high = middle;
+            }
+        }
+        
+        if (low > 0) {
+            I64 j = i;
+            for (I64 k = 0; k < low; k++) {
+                array[j] = array[j-gap];
+                j -= gap;
+            }
+            array[j] = temp;
+        }
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// same passes as shellSortCustomWithLastGaps, every pass including gap 1 uses shellSortSingleGapBinary
+KERNEL_RET KERNEL(shellSortCustomWithLastGapsBinary)(KERNEL_TYPE array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    KERNEL_COUNT_BEGIN
+    if (length < 2) {
+        KERNEL_COUNT_RETURN;
+    }
+    
+    // find initial gap (largest gap that is less than length)
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    
+    I64 gap = lastGaps[--g];
+    while (1) {
+        KERNEL_COUNT_ADD(KERNEL(shellSortSingleGapBinary)(array, length, gap));
+        if (g == 0) break;
+        gap = gaps[--g];
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+KERNEL_RET KERNEL(shellSortCustomBinary)(KERNEL_TYPE array[], I64 length, const I64 gaps[]) {
+    return KERNEL(shellSortCustomWithLastGapsBinary)(array, length, gaps, gaps);
+}
+
+// checks evenly spaced pairs (i-gap, i) for an inversion, stops at the first one found
+// probes at most 32 + (length-gap)/64 pairs, so a random array costs about 2 compares and a sorted one under 2% of a pass
+static KERNEL_RET KERNEL(shellSortProbeGap)(KERNEL_TYPE array[], I64 length, I64 gap, int* inversionFound) {
+    KERNEL_COUNT_BEGIN
+    *inversionFound = 0;
+    I64 numPairs = length - gap;
+    I64 numProbes = 32 + numPairs / 64;
+    if (numProbes > numPairs) numProbes = numPairs;
+    for (I64 k = 0; k < numProbes; k++) {
+        I64 i = gap + (numPairs * (2*k + 1)) / (2*numProbes);
+        if (KERNEL_GREATER(array[i-gap], array[i])) {
+            *inversionFound = 1;
+            break;
+        }
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// same as shellSortCustomWithLastGaps, but a pass is skipped when shellSortProbeGap finds no inversion at its gap
+// the probe only samples, so the next smaller gap is probed again rather than trusting the array to be presorted:
+// jumping straight to a gap 1 pass would move an element d places from home one slot at a time, O(length*d) moves,
+// e.g. 57x slower than shellSortCustom on 1e6 elements shuffled within blocks of 50000 even though it did fewer compares
+// random arrays never skip, they pay about 2 extra compares per pass and otherwise run exactly the passes of shellSortCustomWithLastGaps
+KERNEL_RET KERNEL(shellSortCustomWithLastGapsAdaptive)(KERNEL_TYPE array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    KERNEL_COUNT_BEGIN
+    // find initial gap (largest gap that is less than length)
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    
+    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
+        // passes shorter than 1024 compares are not worth probing, keeps the overhead on small random arrays under 0.2% per pass
+        int inversionFound = 1;
+        if (length - gap >= 1024) {
+            KERNEL_COUNT_ADD(KERNEL(shellSortProbeGap)(array, length, gap, &inversionFound));
+        }
+        if (!inversionFound) {
+            continue;
+        }
+        KERNEL_COUNT_ADD(KERNEL(shellSortSingleGap)(array, length, gap));
+    }
+    
+    KERNEL_COUNT_ADD(KERNEL(insertionSort)(array, length));
+    KERNEL_COUNT_RETURN;
+}
+
+KERNEL_RET KERNEL(shellSortCustomAdaptive)(KERNEL_TYPE array[], I64 length, const I64 gaps[]) {
+    return KERNEL(shellSortCustomWithLastGapsAdaptive)(array, length, gaps, gaps);
+}
+
+// pratt shell sort as one compare-exchange sweep per gap, gaps must be the 3-smooth numbers in increasing order ending in -1 (gaps_pratt1971)
+// and must hold every one of them below length, a table that runs out early would leave the array unsorted, so that is an error
+// when an array is 2h-sorted and 3h-sorted every h-chain is only out of order between disjoint neighbouring pairs,
+// so comparing and swapping each (i-h, i) once in increasing i h-sorts it, and the largest gaps start out 2h and 3h sorted trivially
+// which elements are compared never depends on the data: always exactly the sum of (length - h) compares, no branches to mispredict
+// and each row of h pairs is independent, so the inner loop vectorizes (min/max) for the plain types
+KERNEL_RET KERNEL(shellSortPrattOblivious)(KERNEL_TYPE array[], I64 length, const I64 gaps[]) {
+    KERNEL_COUNT_BEGIN
+    I64 g = 0;
+    while (gaps[g] < length && gaps[g] > 0) {
+        g++;
+    }
+    if (gaps[g] <= 0 && g > 0) {
+        // table ran out, the smallest 3-smooth number above the last gap must not be below length
+        I64 last = gaps[g-1];
+        I64 next = 2 * last;
+        for (I64 k = 0; k < g; k++) {
+            if (2 * gaps[k] > last && 2 * gaps[k] < next) next = 2 * gaps[k];
+            if (3 * gaps[k] > last && 3 * gaps[k] < next) next = 3 * gaps[k];
+        }
+        if (next < length) {
+            printf("error 592\n");
+            exit(1);
+        }
+    }
+    for (g--; g >= 0; g--) {
+        I64 gap = gaps[g];
+        for (I64 base = gap; base < length; base += gap) {
+            I64 end = base + gap < length ? base + gap : length;
+            for (I64 i = base; i < end; i++) {
+                KERNEL_TYPE a = array[i-gap];
+                KERNEL_TYPE b = array[i];
+                int greater = KERNEL_GREATER(a, b);
+                array[i-gap] = greater ? b : a;
+                array[i] = greater ? a : b;
+            }
+        }
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// one pass with a large gap, done as SHELLSORT_BLOCKED_TILE_BYTES worth of consecutive chains at a time
+// each tile is gathered row by row (one cache line per row) into contiguous scratch, insertion sorted there and scattered back
+// chains are independent, so the compares are exactly the ones shellSortSingleGap does, only the memory access order changes
+static KERNEL_RET KERNEL(shellSortSingleGapBlocked)(KERNEL_TYPE array[], I64 length, I64 gap, KERNEL_TYPE scratch[], I64 maxChainLength) {
+    KERNEL_COUNT_BEGIN
+    I64 tileChains = SHELLSORT_BLOCKED_TILE_BYTES / (I64)sizeof(KERNEL_TYPE);
+    if (tileChains < 1) tileChains = 1;
+    
+    for (I64 r = 0; r < gap; r += tileChains) {
+        I64 chains = (gap - r < tileChains) ? gap - r : tileChains;
+        I64 firstLength = (length - r + gap - 1) / gap;// chain r is the longest in the tile, later chains are the same or 1 shorter
+        I64 lastLength = (length - (r + chains - 1) + gap - 1) / gap;
+        
+        for (I64 k = 0; k < firstLength; k++) {
+            KERNEL_TYPE const* row = &array[r + k*gap];
+            I64 rowChains = (k < lastLength) ? chains : (length - (r + k*gap));
+            for (I64 b = 0; b < rowChains; b++) {
+                scratch[b*maxChainLength + k] = row[b];
+            }
+        }
+        for (I64 b = 0; b < chains; b++) {
+            I64 chainLength = (length - (r + b) + gap - 1) / gap;
+            KERNEL_COUNT_ADD(KERNEL(insertionSort)(&scratch[b*maxChainLength], chainLength));
+        }
+        for (I64 k = 0; k < firstLength; k++) {
+            KERNEL_TYPE* row = &array[r + k*gap];
+            I64 rowChains = (k < lastLength) ? chains : (length - (r + k*gap));
+            for (I64 b = 0; b < rowChains; b++) {
+                row[b] = scratch[b*maxChainLength + k];
+            }
+        }
+    }
+    KERNEL_COUNT_RETURN;
+}
+
+// same passes and same compares as shellSortCustomWithLastGaps, for arrays much larger than the cache
+// passes with gap >= SHELLSORT_BLOCKED_MIN_GAP and chains of at least SHELLSORT_BLOCKED_MIN_CHAIN use shellSortSingleGapBlocked,
+// each of them reads and writes the array once in cache line rows
+// allocates scratch for SHELLSORT_BLOCKED_TILE_BYTES worth of the longest chains, about length/SHELLSORT_BLOCKED_MIN_GAP cache lines
+KERNEL_RET KERNEL(shellSortCustomWithLastGapsBlocked)(KERNEL_TYPE array[], I64 length, const I64 gaps[], const I64 lastGaps[]) {
+    KERNEL_COUNT_BEGIN
+    // find initial gap (largest gap that is less than length)
+    I64 g = 0;
+    while (lastGaps[g] < length && lastGaps[g] > 0) {
+        g++;
+    }
+    
+    KERNEL_TYPE* scratch = NULL;
+    I64 maxChainLength = length / SHELLSORT_BLOCKED_MIN_GAP + 1;
+    if (length / SHELLSORT_BLOCKED_MIN_GAP >= SHELLSORT_BLOCKED_MIN_CHAIN) {
+        I64 tileChains = SHELLSORT_BLOCKED_TILE_BYTES / (I64)sizeof(KERNEL_TYPE);
+        if (tileChains < 1) tileChains = 1;
+        scratch = malloc(sizeof(KERNEL_TYPE) * tileChains * maxChainLength);
+    }
+    
+    for (I64 gap = lastGaps[--g]; g > 0; gap = gaps[--g]) {
+        if (gap >= SHELLSORT_BLOCKED_MIN_GAP && length / gap >= SHELLSORT_BLOCKED_MIN_CHAIN) {
+            KERNEL_COUNT_ADD(KERNEL(shellSortSingleGapBlocked)(array, length, gap, scratch, maxChainLength));
+        }
+        else {
+            KERNEL_COUNT_ADD(KERNEL(shellSortSingleGap)(array, length, gap));
+        }
+    }
+    free(scratch);
+    
+    KERNEL_COUNT_ADD(KERNEL(insertionSort)(array, length));
+    KERNEL_COUNT_RETURN;
+}
+
+#undef KERNEL
+#undef KERNEL_CONCAT
+#undef KERNEL_CONCAT_
+#undef KERNEL_TYPE
+#undef KERNEL_KEY
+#undef KERNEL_RET
+#undef KERNEL_COUNT_BEGIN
+#undef KERNEL_GREATER
+#undef KERNEL_COUNT_ADD
+#undef KERNEL_COUNT_ADD_THREAD
+#undef KERNEL_COUNT_RETURN
+#undef KERNEL_THREAD_COUNT
+#undef KERNEL_COUNT_TLS
+#undef KERNEL_COUNT_LOCAL
+#undef KERNEL_SUFFIX